@@ -0,0 +1,166 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * cred.c measures the credential emulation in core/cred.c on its own,
+ * calling the __rr_do_* functions directly on a cred_t (no tracing, no
+ * syscalls). This is the floor for what any shim can cost, so it's the
+ * thing to look at when making the core faster.
+ *
+ * Most cases start from (and stay) root, so they can be repeated without
+ * resetting anything. The "drop" cases can't, so each iteration includes
+ * a cred_clone back to root first; subtract the "clone" case to get the
+ * cost of the transition itself.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/capability.h>
+
+#include "common.h"
+#include "core/cred.h"
+
+static long iterations = 100000;
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [-n <iterations>] [-g <ngroups>]\n", __progname);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Prints the time per iteration of body, in a machine-readable form. */
+#define BENCH(name, body) \
+	do { \
+		double start = now(); \
+		for (long i = 0; i < iterations; i++) { \
+			body; \
+		} \
+		printf("%s\t%.1f\n", name, (now() - start) / iterations); \
+	} while (0)
+
+/* Makes sure a transition that should succeed actually did. */
+#define CHECK(call) \
+	do { \
+		if ((call) < 0) \
+			die("%s failed", #call); \
+	} while (0)
+
+int main(int argc, char **argv)
+{
+	int ngroups = NGROUPS_MAX;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:g:h")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			case 'g':
+				ngroups = atoi(optarg);
+				if (ngroups < 0 || ngroups > NGROUPS_MAX)
+					rtfm("invalid number of groups: %s", optarg);
+				break;
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind != argc)
+		rtfm("unexpected arguments");
+
+	/* These are far too big for the stack. */
+	struct cred_t *root = malloc(sizeof(*root));
+	struct cred_t *current = malloc(sizeof(*current));
+	gid_t *list = malloc(NGROUPS_MAX * sizeof(gid_t));
+	if (!root || !current || !list)
+		die("malloc failed: %m");
+
+	/* cred_new always gives us full capabilities, whoever we really are. */
+	cred_new(root);
+	cred_clone(current, root);
+
+	/* Unsorted, so setgroups(2) has to do the work of sorting them. */
+	srand(1);
+	for (int i = 0; i < ngroups; i++)
+		list[i] = rand();
+
+	struct __user_cap_header_struct header = { .version = _LINUX_CAPABILITY_VERSION_3 };
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+	struct cred_bprm_t bprm = {0};
+	uid_t ruid, euid, suid;
+
+	BENCH("getuid", __rr_do_getuid(current));
+	BENCH("getresuid", __rr_do_getresuid(current, &ruid, &euid, &suid));
+	BENCH("clone", cred_clone(current, root));
+
+	BENCH("setuid", CHECK(__rr_do_setuid(current, 0)));
+	BENCH("setreuid", CHECK(__rr_do_setreuid(current, 0, 0)));
+	BENCH("setresuid", CHECK(__rr_do_setresuid(current, 0, 0, 0)));
+	BENCH("setfsuid", __rr_do_setfsuid(current, 0));
+	BENCH("setgid", CHECK(__rr_do_setgid(current, 0)));
+	BENCH("setresgid", CHECK(__rr_do_setresgid(current, 0, 0, 0)));
+
+	/* The saved uid stays root, so we can always go back. */
+	BENCH("seteuid-toggle", {
+		CHECK(__rr_do_seteuid(current, 1000));
+		CHECK(__rr_do_seteuid(current, 0));
+	});
+
+	BENCH("setuid-drop", {
+		cred_clone(current, root);
+		CHECK(__rr_do_setuid(current, 1000));
+	});
+	BENCH("setresuid-drop", {
+		cred_clone(current, root);
+		CHECK(__rr_do_setresuid(current, 1000, 1000, 1000));
+	});
+
+	cred_clone(current, root);
+	BENCH("capget", CHECK(__rr_do_capget(current, &header, data)));
+	BENCH("capset", CHECK(__rr_do_capset(current, &header, data)));
+	BENCH("exec", cred_exec(current, &bprm));
+
+	/* Sorting a large group list takes far longer than anything else. */
+	if (ngroups > 1024 && iterations >= 100)
+		iterations /= 100;
+
+	char name[64];
+	snprintf(name, sizeof(name), "setgroups-%d", ngroups);
+	BENCH(name, CHECK(__rr_do_setgroups(current, ngroups, list)));
+	snprintf(name, sizeof(name), "getgroups-%d", ngroups);
+	BENCH(name, CHECK(__rr_do_getgroups(current, NGROUPS_MAX, list)));
+	snprintf(name, sizeof(name), "has_group-%d", ngroups);
+	BENCH(name, cred_has_group(current, list[i % (ngroups ? ngroups : 1)] + (i & 1)));
+
+	free(list);
+	free(current);
+	free(root);
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ptrace.c measures the different ways a tracer can get at a stopped
+ * tracee, so that the backend in ptrace/ can use whichever is cheapest on
+ * the kernel we're running on. The tracee is a child stopped at the entry
+ * of a syscall (the same state the shims see), and we time:
+ *
+ *  - reading the syscall number and arguments: with a PTRACE_PEEKUSER per
+ *    register (what ptrace/amd64.c does), PTRACE_GETREGS, PTRACE_GETREGSET
+ *    and PTRACE_GET_SYSCALL_INFO.
+ *  - reading tracee memory of various sizes: with PTRACE_PEEKDATA a word at
+ *    a time, process_vm_readv(2) (what ptrace/generic.c does) and pread(2)
+ *    of /proc/<pid>/mem.
+ *
+ * The output is TSV of {method, bytes, ns per operation}.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/reg.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <elf.h>
+
+#include "common.h"
+
+static long iterations = 100000;
+
+/* The child is a copy of us, so this is at the same address in the tracee. */
+#define MAX_SIZE 65536
+static char buffer[MAX_SIZE];
+
+static const size_t sizes[] = { 8, 64, 512, 4096, MAX_SIZE };
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [-n <iterations>]\n", __progname);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Prints the time per iteration of body, in a machine-readable form. */
+#define BENCH(name, size, body) \
+	do { \
+		double start = now(); \
+		for (long i = 0; i < iterations; i++) { \
+			body; \
+		} \
+		printf("%s\t%zu\t%.1f\n", name, (size_t) (size), (now() - start) / iterations); \
+	} while (0)
+
+/* Makes sure we're measuring something that actually worked. */
+#define CHECK(call) \
+	do { \
+		if ((call) < 0) \
+			die("%s failed: %m", #call); \
+	} while (0)
+
+/* The registers the shims need: the syscall number and its arguments. */
+static const int syscall_regs[] = { ORIG_RAX, RDI, RSI, RDX, R10, R8, R9 };
+
+static void peekuser(pid_t pid)
+{
+	for (size_t i = 0; i < sizeof(syscall_regs) / sizeof(*syscall_regs); i++) {
+		errno = 0;
+		ptrace(PTRACE_PEEKUSER, pid, sizeof(long) * syscall_regs[i], NULL);
+		if (errno)
+			die("PTRACE_PEEKUSER failed: %m");
+	}
+}
+
+static void peekdata(pid_t pid, size_t len)
+{
+	for (size_t done = 0; done < len; done += sizeof(long)) {
+		errno = 0;
+		ptrace(PTRACE_PEEKDATA, pid, buffer + done, NULL);
+		if (errno)
+			die("PTRACE_PEEKDATA failed: %m");
+	}
+}
+
+static ssize_t vm_readv(pid_t pid, void *buf, size_t len)
+{
+	struct iovec local = { .iov_base = buf, .iov_len = len };
+	struct iovec remote = { .iov_base = buffer, .iov_len = len };
+
+	return process_vm_readv(pid, &local, 1, &remote, 1, 0);
+}
+
+/* Starts a child that is stopped at the entry of getppid(2). */
+static pid_t spawn(void)
+{
+	int status;
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+			_exit(1);
+		raise(SIGSTOP);
+		syscall(SYS_getppid);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+		die("child didn't stop");
+	CHECK(ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+	CHECK(ptrace(PTRACE_SYSCALL, pid, NULL, NULL));
+	if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status) || WSTOPSIG(status) != (SIGTRAP | 0x80))
+		die("child didn't stop at a syscall");
+	return pid;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind != argc)
+		rtfm("unexpected arguments");
+
+	pid_t pid = spawn();
+
+	struct user_regs_struct regs;
+	struct iovec regset = { .iov_base = &regs, .iov_len = sizeof(regs) };
+	static char local[MAX_SIZE];
+
+	BENCH("peekuser", 7 * sizeof(long), peekuser(pid));
+	BENCH("getregs", sizeof(regs), CHECK(ptrace(PTRACE_GETREGS, pid, NULL, &regs)));
+	BENCH("getregset", sizeof(regs), CHECK(ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &regset)));
+#if defined(PTRACE_GET_SYSCALL_INFO)
+	struct __ptrace_syscall_info info;
+	BENCH("get_syscall_info", sizeof(info),
+	      CHECK(ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info)));
+#endif
+
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+	int memfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (memfd < 0)
+		die("open(%s) failed: %m", path);
+
+	/* PTRACE_PEEKDATA of the larger sizes would otherwise take forever. */
+	long base = iterations;
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		size_t len = sizes[i];
+
+		iterations = base / (len / 512 + 1);
+		if (!iterations)
+			iterations = 1;
+
+		BENCH("peekdata", len, peekdata(pid, len));
+		BENCH("process_vm_readv", len, CHECK(vm_readv(pid, local, len)));
+		BENCH("proc_mem", len, CHECK(pread(memfd, local, len, (uintptr_t) buffer)));
+	}
+
+	close(memfd);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return 0;
+}
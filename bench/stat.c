@@ -0,0 +1,144 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * stat.c measures the cost of each of the stat(2) family on a single file,
+ * as well as getppid(2) (which remainroot doesn't touch) as a baseline for
+ * the cost of a traced syscall. Run it natively and under remainroot, with
+ * and without the file being chown(2)ed, to get the cost of the rewriting.
+ *
+ * Optionally, the inode table can be filled with a lot of other faked
+ * files first, to see how lookups scale.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+
+static long iterations = 100000;
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [-n <iterations>] [-f <files>] [-c <uid>:<gid>] <file>\n", __progname);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Prints the time per iteration of body, in a machine-readable form. */
+#define BENCH(name, body) \
+	do { \
+		double start = now(); \
+		for (long i = 0; i < iterations; i++) { \
+			body; \
+		} \
+		printf("%s\t%.1f\n", name, (now() - start) / iterations); \
+	} while (0)
+
+/* Fill the inode table with nfiles faked files, in a temporary directory. */
+static void fill(long nfiles, uid_t uid, gid_t gid)
+{
+	char dir[] = "/tmp/remainroot-bench.XXXXXX";
+	if (!mkdtemp(dir))
+		die("mkdtemp failed: %m");
+
+	int dirfd = open(dir, O_DIRECTORY | O_RDONLY);
+	if (dirfd < 0)
+		die("open(%s) failed: %m", dir);
+
+	for (long i = 0; i < nfiles; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "%ld", i);
+
+		int fd = openat(dirfd, name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			die("openat(%s) failed: %m", name);
+		if (fchown(fd, uid, gid) < 0)
+			warn("fchown(%s) failed: %m", name);
+		close(fd);
+	}
+
+	/* Removing them again would also empty the table, so leave them around. */
+	fprintf(stderr, "filled %s with %ld files\n", dir, nfiles);
+	close(dirfd);
+}
+
+int main(int argc, char **argv)
+{
+	long nfiles = 0;
+	uid_t uid = -1;
+	gid_t gid = -1;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:f:c:h")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			case 'f':
+				nfiles = atol(optarg);
+				break;
+			case 'c':
+				if (sscanf(optarg, "%u:%u", &uid, &gid) != 2)
+					rtfm("invalid owner: %s", optarg);
+				break;
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind != argc - 1)
+		rtfm("file required");
+
+	const char *path = argv[optind];
+	struct stat st;
+	struct statx stx;
+
+	if (nfiles)
+		fill(nfiles, uid == (uid_t) -1 ? 0 : uid, gid == (gid_t) -1 ? 0 : gid);
+	if ((uid != (uid_t) -1 || gid != (gid_t) -1) && chown(path, uid, gid) < 0)
+		die("chown(%s) failed: %m", path);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die("open(%s) failed: %m", path);
+
+	BENCH("getppid", syscall(SYS_getppid));
+	BENCH("stat", stat(path, &st));
+	BENCH("lstat", lstat(path, &st));
+	BENCH("fstat", fstat(fd, &st));
+	BENCH("fstatat", fstatat(AT_FDCWD, path, &st, 0));
+	BENCH("statx", statx(AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx));
+
+	close(fd);
+	return 0;
+}
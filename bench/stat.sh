@@ -0,0 +1,60 @@
+#!/bin/sh
+# remainroot: a shim to trick code to run in a rootless container
+# Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+#
+# remainroot is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# remainroot is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+
+# usage: stat.sh <remainroot> <bench-stat>
+#
+# Runs bench-stat natively and under remainroot, and prints (as TSV) how
+# much remainroot adds to each stat(2)-family call on top of the cost of
+# stopping at a syscall at all (measured with getppid(2), which isn't
+# shimmed). The "faked" cases are the ones that take the rewriting path.
+
+set -e
+
+REMAINROOT="$1"
+BENCH="$2"
+ITERATIONS="${ITERATIONS:-100000}"
+FILL="${FILL:-100000}"
+
+file="$(mktemp)"
+trap 'rm -f "$file"' EXIT
+
+run() {
+	name="$1"
+	shift
+	"$@" -n "$ITERATIONS" "$file" | sed "s/^/$name\t/"
+}
+
+{
+	run native "$BENCH"
+	run unfaked "$REMAINROOT" "$BENCH"
+	run faked "$REMAINROOT" "$BENCH" -c 1000:1000
+	run faked-filled "$REMAINROOT" "$BENCH" -c 1000:1000 -f "$FILL"
+} | awk -F'\t' '
+	{ ns[$1, $2] = $3; if (!seen[$2]++) calls[n++] = $2 }
+	END {
+		printf "case\tsyscall\tns_per_op\tadded_ns\n"
+		split("unfaked faked faked-filled", cases, " ")
+		for (c = 1; c <= 3; c++) {
+			stop = ns[cases[c], "getppid"] - ns["native", "getppid"]
+			for (i = 0; i < n; i++) {
+				if (calls[i] == "getppid")
+					continue
+				added = ns[cases[c], calls[i]] - ns["native", calls[i]] - stop
+				printf "%s\t%s\t%.1f\t%.1f\n", cases[c], calls[i], ns[cases[c], calls[i]], added
+			}
+		}
+	}'
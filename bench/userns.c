@@ -0,0 +1,627 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * userns.c checks the credential emulation in core/cred.c against the
+ * real thing. Root in a user namespace has the same rules as root on the
+ * host, so we run random sequences of credential syscalls both on the
+ * kernel (as root in a fresh user namespace) and on a cred_t, and compare
+ * the results and the credentials after every step.
+ *
+ * Anyone can map 0 to their own uid (like --userns does), so that's
+ * always checked, though only id 0 can be used. Mapping more ids than
+ * that needs newuidmap(1) and newgidmap(1) (or real root), so it's
+ * skipped when they aren't there. Ids that aren't mapped are never used,
+ * since the kernel rejects them with EINVAL and we have no idea of maps.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/capability.h>
+#include <linux/securebits.h>
+
+#include "common.h"
+#include "core/cred.h"
+
+/* How many ids (from 0) we map when we can map more than one. */
+#define NIDS 4
+
+static long sequences = 1000;
+static int length = 16;
+static unsigned int seed = 1;
+
+/* The ids the current run can use, and the capabilities the kernel has. */
+static int nids;
+static uint64_t cap_mask;
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [-n <sequences>] [-l <length>] [-s <seed>]\n", __progname);
+}
+
+/* The credentials, as both sides can report them. */
+struct snapshot_t {
+	uid_t uid, euid, suid, fsuid;
+	gid_t gid, egid, sgid, fsgid;
+	uint64_t effective, permitted, inheritable, bset, ambient;
+	long securebits;
+	int ngroups;
+	gid_t groups[NIDS];
+};
+
+static int gid_cmp(const void *a, const void *b)
+{
+	gid_t x = *(const gid_t *) a, y = *(const gid_t *) b;
+	return (x > y) - (x < y);
+}
+
+static void snapshot_kernel(struct snapshot_t *snap)
+{
+	struct __user_cap_header_struct header = { .version = _LINUX_CAPABILITY_VERSION_3 };
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+	gid_t groups[NGROUPS_MAX];
+
+	*snap = (struct snapshot_t) {0};
+	syscall(SYS_getresuid, &snap->uid, &snap->euid, &snap->suid);
+	syscall(SYS_getresgid, &snap->gid, &snap->egid, &snap->sgid);
+	snap->fsuid = syscall(SYS_setfsuid, -1);
+	snap->fsgid = syscall(SYS_setfsgid, -1);
+
+	if (syscall(SYS_capget, &header, data) < 0)
+		die("capget failed: %m");
+	for (int i = 0; i < _LINUX_CAPABILITY_U32S_3; i++) {
+		snap->effective |= (uint64_t) data[i].effective << (32 * i);
+		snap->permitted |= (uint64_t) data[i].permitted << (32 * i);
+		snap->inheritable |= (uint64_t) data[i].inheritable << (32 * i);
+	}
+	for (int cap = 0; cap <= CAP_LAST_CAP; cap++) {
+		if (prctl(PR_CAPBSET_READ, cap, 0, 0, 0) > 0)
+			snap->bset |= 1ULL << cap;
+		if (prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_IS_SET, cap, 0, 0) > 0)
+			snap->ambient |= 1ULL << cap;
+	}
+	snap->securebits = prctl(PR_GET_SECUREBITS, 0, 0, 0, 0);
+
+	/* Unmapped groups show up as the overflow gid, which cred_new drops. */
+	int n = syscall(SYS_getgroups, NGROUPS_MAX, groups);
+	for (int i = 0; i < n; i++)
+		if (groups[i] < NIDS && snap->ngroups < NIDS)
+			snap->groups[snap->ngroups++] = groups[i];
+	qsort(snap->groups, snap->ngroups, sizeof(gid_t), gid_cmp);
+}
+
+static void snapshot_emulated(struct snapshot_t *snap, struct cred_t *cred)
+{
+	*snap = (struct snapshot_t) {
+		.uid         = cred->uid,
+		.euid        = cred->euid,
+		.suid        = cred->suid,
+		.fsuid       = cred->fsuid,
+		.gid         = cred->gid,
+		.egid        = cred->egid,
+		.sgid        = cred->sgid,
+		.fsgid       = cred->fsgid,
+		.effective   = cred->cap_effective,
+		.permitted   = cred->cap_permitted,
+		.inheritable = cred->cap_inheritable,
+		.bset        = cred->cap_bset,
+		.ambient     = cred->cap_ambient,
+		.securebits  = cred->securebits,
+	};
+	for (int i = 0; i < cred->ngroups; i++)
+		if (cred->groups[i] < NIDS && snap->ngroups < NIDS)
+			snap->groups[snap->ngroups++] = cred->groups[i];
+}
+
+static void snapshot_print(const char *name, struct snapshot_t *snap)
+{
+	fprintf(stderr, "  %-8s uid=%d/%d/%d/%d gid=%d/%d/%d/%d caps=%#llx/%#llx/%#llx bset=%#llx ambient=%#llx securebits=%#lx groups=",
+	        name, snap->uid, snap->euid, snap->suid, snap->fsuid,
+	        snap->gid, snap->egid, snap->sgid, snap->fsgid,
+	        (unsigned long long) snap->effective, (unsigned long long) snap->permitted,
+	        (unsigned long long) snap->inheritable, (unsigned long long) snap->bset,
+	        (unsigned long long) snap->ambient, snap->securebits);
+	for (int i = 0; i < snap->ngroups; i++)
+		fprintf(stderr, "%s%d", i ? "," : "", snap->groups[i]);
+	fprintf(stderr, "\n");
+}
+
+static bool snapshot_equal(struct snapshot_t *a, struct snapshot_t *b)
+{
+	return a->uid == b->uid && a->euid == b->euid && a->suid == b->suid && a->fsuid == b->fsuid &&
+	       a->gid == b->gid && a->egid == b->egid && a->sgid == b->sgid && a->fsgid == b->fsgid &&
+	       !((a->effective ^ b->effective) & cap_mask) &&
+	       !((a->permitted ^ b->permitted) & cap_mask) &&
+	       !((a->inheritable ^ b->inheritable) & cap_mask) &&
+	       !((a->bset ^ b->bset) & cap_mask) &&
+	       !((a->ambient ^ b->ambient) & cap_mask) &&
+	       a->securebits == b->securebits &&
+	       a->ngroups == b->ngroups &&
+	       !memcmp(a->groups, b->groups, a->ngroups * sizeof(gid_t));
+}
+
+/* A mapped id, or sometimes -1 (which means "unchanged" to most syscalls). */
+static uid_t random_id(void)
+{
+	int n = rand() % (nids + 1);
+	return n == nids ? (uid_t) -1 : (uid_t) n;
+}
+
+/* The capabilities that matter for the syscalls we make, plus a bystander. */
+static const int cap_pool[] = { CAP_CHOWN, CAP_DAC_OVERRIDE, CAP_SETGID, CAP_SETUID, CAP_SETPCAP };
+#define NCAPS (sizeof(cap_pool) / sizeof(*cap_pool))
+
+static int random_cap(void)
+{
+	return cap_pool[rand() % NCAPS];
+}
+
+/* Flips some of the pool's capabilities in set. */
+static uint64_t random_caps(uint64_t set)
+{
+	for (unsigned int i = 0; i < NCAPS; i++)
+		if (rand() % 4 == 0)
+			set ^= 1ULL << cap_pool[i];
+	return set;
+}
+
+/* A syscall we make on both sides, as a description and its arguments. */
+struct step_t {
+	char name[128];
+	int call;
+	unsigned long args[5];
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+};
+
+enum {
+	STEP_SETUID, STEP_SETREUID, STEP_SETRESUID, STEP_SETFSUID,
+	STEP_SETGID, STEP_SETREGID, STEP_SETRESGID, STEP_SETFSGID,
+	STEP_SETGROUPS, STEP_CAPSET, STEP_PRCTL, STEP_MAX,
+};
+
+static const int prctl_options[] = {
+	PR_SET_KEEPCAPS, PR_SET_SECUREBITS, PR_CAPBSET_DROP, PR_CAP_AMBIENT,
+};
+
+static void step_random(struct step_t *step, struct cred_t *cred)
+{
+	*step = (struct step_t) { .call = rand() % STEP_MAX };
+
+	/* setgroups(2) is denied in a user namespace we mapped ourselves. */
+	if (step->call == STEP_SETGROUPS && nids == 1)
+		step->call = STEP_SETUID;
+
+	for (int i = 0; i < 3; i++)
+		step->args[i] = random_id();
+
+	switch (step->call) {
+		case STEP_SETUID:
+			snprintf(step->name, sizeof(step->name), "setuid(%d)", (int) step->args[0]);
+			break;
+		case STEP_SETREUID:
+			snprintf(step->name, sizeof(step->name), "setreuid(%d, %d)", (int) step->args[0], (int) step->args[1]);
+			break;
+		case STEP_SETRESUID:
+			snprintf(step->name, sizeof(step->name), "setresuid(%d, %d, %d)",
+			         (int) step->args[0], (int) step->args[1], (int) step->args[2]);
+			break;
+		case STEP_SETFSUID:
+			snprintf(step->name, sizeof(step->name), "setfsuid(%d)", (int) step->args[0]);
+			break;
+		case STEP_SETGID:
+			snprintf(step->name, sizeof(step->name), "setgid(%d)", (int) step->args[0]);
+			break;
+		case STEP_SETREGID:
+			snprintf(step->name, sizeof(step->name), "setregid(%d, %d)", (int) step->args[0], (int) step->args[1]);
+			break;
+		case STEP_SETRESGID:
+			snprintf(step->name, sizeof(step->name), "setresgid(%d, %d, %d)",
+			         (int) step->args[0], (int) step->args[1], (int) step->args[2]);
+			break;
+		case STEP_SETFSGID:
+			snprintf(step->name, sizeof(step->name), "setfsgid(%d)", (int) step->args[0]);
+			break;
+
+		case STEP_SETGROUPS:
+			/* The list goes in args, and no -1s. */
+			step->args[0] = rand() % (nids + 1);
+			for (unsigned long i = 0; i < step->args[0]; i++)
+				step->args[1 + i] = rand() % nids;
+			snprintf(step->name, sizeof(step->name), "setgroups(%lu)", step->args[0]);
+			break;
+
+		case STEP_CAPSET: {
+			uint64_t effective = random_caps(cred->cap_effective);
+			uint64_t permitted = random_caps(cred->cap_permitted);
+			uint64_t inheritable = random_caps(cred->cap_inheritable);
+			for (int i = 0; i < _LINUX_CAPABILITY_U32S_3; i++) {
+				step->data[i].effective = effective >> (32 * i);
+				step->data[i].permitted = permitted >> (32 * i);
+				step->data[i].inheritable = inheritable >> (32 * i);
+			}
+			snprintf(step->name, sizeof(step->name), "capset(%#llx, %#llx, %#llx)",
+			         (unsigned long long) effective, (unsigned long long) permitted,
+			         (unsigned long long) inheritable);
+			break;
+		}
+
+		case STEP_PRCTL:
+			step->args[0] = prctl_options[rand() % (sizeof(prctl_options) / sizeof(*prctl_options))];
+			step->args[2] = step->args[3] = step->args[4] = 0;
+			switch (step->args[0]) {
+				case PR_SET_KEEPCAPS:
+					step->args[1] = rand() % 3;
+					break;
+				case PR_SET_SECUREBITS:
+					/* Newer kernels have more bits than our headers know about. */
+					step->args[1] = rand() & (SECURE_ALL_BITS | SECURE_ALL_LOCKS);
+					break;
+				case PR_CAPBSET_DROP:
+					step->args[1] = random_cap();
+					break;
+				case PR_CAP_AMBIENT:
+					step->args[1] = 1 + rand() % 4;
+					if (step->args[1] != PR_CAP_AMBIENT_CLEAR_ALL)
+						step->args[2] = random_cap();
+					break;
+			}
+			snprintf(step->name, sizeof(step->name), "prctl(%lu, %lu, %lu)",
+			         step->args[0], step->args[1], step->args[2]);
+			break;
+	}
+}
+
+/* Returns the result of step, as -errno on failure. */
+static long step_kernel(struct step_t *step)
+{
+	struct __user_cap_header_struct header = { .version = _LINUX_CAPABILITY_VERSION_3 };
+	gid_t list[NIDS];
+	long ret = -1;
+
+	errno = 0;
+	switch (step->call) {
+		case STEP_SETUID:
+			ret = syscall(SYS_setuid, step->args[0]);
+			break;
+		case STEP_SETREUID:
+			ret = syscall(SYS_setreuid, step->args[0], step->args[1]);
+			break;
+		case STEP_SETRESUID:
+			ret = syscall(SYS_setresuid, step->args[0], step->args[1], step->args[2]);
+			break;
+		case STEP_SETFSUID:
+			/* This can't fail, it just returns the old fsuid. */
+			return syscall(SYS_setfsuid, step->args[0]);
+		case STEP_SETGID:
+			ret = syscall(SYS_setgid, step->args[0]);
+			break;
+		case STEP_SETREGID:
+			ret = syscall(SYS_setregid, step->args[0], step->args[1]);
+			break;
+		case STEP_SETRESGID:
+			ret = syscall(SYS_setresgid, step->args[0], step->args[1], step->args[2]);
+			break;
+		case STEP_SETFSGID:
+			return syscall(SYS_setfsgid, step->args[0]);
+		case STEP_SETGROUPS:
+			for (unsigned long i = 0; i < step->args[0]; i++)
+				list[i] = step->args[1 + i];
+			ret = syscall(SYS_setgroups, step->args[0], list);
+			break;
+		case STEP_CAPSET:
+			ret = syscall(SYS_capset, &header, step->data);
+			break;
+		case STEP_PRCTL:
+			ret = prctl(step->args[0], step->args[1], step->args[2], step->args[3], step->args[4]);
+			break;
+	}
+	return ret < 0 ? -errno : ret;
+}
+
+static long step_emulated(struct step_t *step, struct cred_t *cred)
+{
+	struct __user_cap_header_struct header = { .version = _LINUX_CAPABILITY_VERSION_3 };
+	gid_t list[NIDS];
+
+	switch (step->call) {
+		case STEP_SETUID:
+			return __rr_do_setuid(cred, step->args[0]);
+		case STEP_SETREUID:
+			return __rr_do_setreuid(cred, step->args[0], step->args[1]);
+		case STEP_SETRESUID:
+			return __rr_do_setresuid(cred, step->args[0], step->args[1], step->args[2]);
+		case STEP_SETFSUID:
+			return __rr_do_setfsuid(cred, step->args[0]);
+		case STEP_SETGID:
+			return __rr_do_setgid(cred, step->args[0]);
+		case STEP_SETREGID:
+			return __rr_do_setregid(cred, step->args[0], step->args[1]);
+		case STEP_SETRESGID:
+			return __rr_do_setresgid(cred, step->args[0], step->args[1], step->args[2]);
+		case STEP_SETFSGID:
+			return __rr_do_setfsgid(cred, step->args[0]);
+		case STEP_SETGROUPS:
+			for (unsigned long i = 0; i < step->args[0]; i++)
+				list[i] = step->args[1 + i];
+			return __rr_do_setgroups(cred, step->args[0], list);
+		case STEP_CAPSET:
+			return __rr_do_capset(cred, &header, step->data);
+		case STEP_PRCTL:
+			return cred_prctl(cred, step->args[0], step->args[1], step->args[2], step->args[3], step->args[4]);
+	}
+	return -EINVAL;
+}
+
+/*
+ * Runs one sequence, as root in the user namespace. This is always in a
+ * fresh child, since there's no going back for the kernel's credentials.
+ */
+static void sequence(long n)
+{
+	struct step_t steps[length];
+	struct snapshot_t kernel, emulated;
+	struct cred_t *cred = malloc(sizeof(*cred));
+	if (!cred)
+		die("malloc failed: %m");
+
+	/* We can't drop anything from the bounding set that the host did. */
+	cred_new(cred);
+	snapshot_kernel(&kernel);
+	cred->cap_bset = kernel.bset;
+
+	srand(seed + n);
+	for (int i = 0; i < length; i++) {
+		step_random(&steps[i], cred);
+		long want = step_kernel(&steps[i]);
+		long got = step_emulated(&steps[i], cred);
+
+		snapshot_kernel(&kernel);
+		snapshot_emulated(&emulated, cred);
+		if (want == got && snapshot_equal(&kernel, &emulated))
+			continue;
+
+		fprintf(stderr, "sequence %ld (with -s %u) went wrong at step %d:\n", n, seed, i);
+		for (int j = 0; j <= i; j++)
+			fprintf(stderr, "  %s\n", steps[j].name);
+		fprintf(stderr, "  returned %ld, but the kernel returned %ld\n", got, want);
+		snapshot_print("kernel", &kernel);
+		snapshot_print("emulated", &emulated);
+		exit(1);
+	}
+	exit(0);
+}
+
+/* Writes a single line to /proc/<pid>/<file>. */
+static int write_file(pid_t pid, const char *file, const char *data)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ssize_t n = write(fd, data, strlen(data));
+	close(fd);
+	return n == (ssize_t) strlen(data) ? 0 : -1;
+}
+
+/* Finds the start of our subordinate ids in /etc/sub{u,g}id, if there are enough. */
+static long subordinate(const char *file, const char *name, uid_t id)
+{
+	char line[256];
+	long start = -1;
+
+	FILE *f = fopen(file, "re");
+	if (!f)
+		return -1;
+	while (start < 0 && fgets(line, sizeof(line), f)) {
+		char owner[128];
+		unsigned long first, count;
+		if (sscanf(line, "%127[^:]:%lu:%lu", owner, &first, &count) != 3 || count < NIDS - 1)
+			continue;
+
+		char *end;
+		unsigned long uid = strtoul(owner, &end, 10);
+		if ((name && !strcmp(owner, name)) || (!*end && uid == id))
+			start = first;
+	}
+	fclose(f);
+	return start;
+}
+
+/* Runs new{u,g}idmap(1) to map 0 to id and 1.. to our subordinate ids. */
+static int newidmap(const char *helper, pid_t pid, uid_t id, long start)
+{
+	char spid[16], sid[16], sstart[16], count[16];
+	snprintf(spid, sizeof(spid), "%d", pid);
+	snprintf(sid, sizeof(sid), "%u", id);
+	snprintf(sstart, sizeof(sstart), "%ld", start);
+	snprintf(count, sizeof(count), "%d", NIDS - 1);
+
+	pid_t child = fork();
+	if (child < 0)
+		return -1;
+	if (!child) {
+		execlp(helper, helper, spid, "0", sid, "1", "1", sstart, count, NULL);
+		_exit(127);
+	}
+
+	int status;
+	if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		return -1;
+	return 0;
+}
+
+/*
+ * Sets up the id mappings of pid's user namespace. With multi, this maps
+ * NIDS ids, either directly (if we're root) or with the setuid helpers.
+ * Returns a reason if it can't be done.
+ */
+static const char *map(pid_t pid, bool multi)
+{
+	uid_t uid = geteuid();
+	gid_t gid = getegid();
+	char data[64];
+
+	if (!multi) {
+		snprintf(data, sizeof(data), "0 %u 1\n", uid);
+		if (write_file(pid, "uid_map", data) < 0)
+			return "couldn't write uid_map";
+		snprintf(data, sizeof(data), "0 %u 1\n", gid);
+		if (write_file(pid, "setgroups", "deny") < 0 || write_file(pid, "gid_map", data) < 0)
+			return "couldn't write gid_map";
+		return NULL;
+	}
+
+	if (!uid) {
+		snprintf(data, sizeof(data), "0 0 %d\n", NIDS);
+		if (write_file(pid, "uid_map", data) < 0 || write_file(pid, "gid_map", data) < 0)
+			return "couldn't write the id maps";
+		return NULL;
+	}
+
+	struct passwd *pw = getpwuid(uid);
+	long substart = subordinate("/etc/subuid", pw ? pw->pw_name : NULL, uid);
+	long subgstart = subordinate("/etc/subgid", pw ? pw->pw_name : NULL, uid);
+	if (substart < 0 || subgstart < 0)
+		return "not enough subordinate ids";
+	if (newidmap("newuidmap", pid, uid, substart) < 0 ||
+	    newidmap("newgidmap", pid, gid, subgstart) < 0)
+		return "newuidmap or newgidmap failed (or aren't installed)";
+	return NULL;
+}
+
+/* Runs every sequence in a new user namespace, with 1 or NIDS ids mapped. */
+static int run(bool multi)
+{
+	int ready[2], go[2];
+	char c = 0;
+
+	if (pipe2(ready, O_CLOEXEC) < 0 || pipe2(go, O_CLOEXEC) < 0)
+		die("pipe failed: %m");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		close(ready[0]);
+		close(go[1]);
+		if (unshare(CLONE_NEWUSER) < 0)
+			_exit(2);
+		/* Wait for the parent to set up our maps. */
+		if (write(ready[1], &c, 1) != 1 || read(go[0], &c, 1) != 1)
+			_exit(2);
+
+		nids = multi ? NIDS : 1;
+		long failed = 0;
+		for (long n = 0; n < sequences; n++) {
+			pid_t child = fork();
+			if (child < 0)
+				die("fork failed: %m");
+			if (!child)
+				sequence(n);
+
+			int status;
+			if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+				failed++;
+		}
+		printf("%s\t%ld\t%ld\n", multi ? "multi-id" : "single-id", sequences, failed);
+		fflush(stdout);
+		_exit(!!failed);
+	}
+
+	close(ready[1]);
+	close(go[0]);
+
+	const char *reason = NULL;
+	if (read(ready[0], &c, 1) != 1)
+		reason = "couldn't create a user namespace";
+	else
+		reason = map(pid, multi);
+	if (!reason && write(go[1], &c, 1) != 1)
+		reason = "child went away";
+	close(ready[0]);
+	close(go[1]);
+
+	int status;
+	if (reason)
+		kill(pid, SIGKILL);
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	if (reason) {
+		warn("skipping %s checks: %s", multi ? "multi-id" : "single-id", reason);
+		return 0;
+	}
+	return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:l:s:h")) != -1) {
+		switch (c) {
+			case 'n':
+				sequences = atol(optarg);
+				break;
+			case 'l':
+				length = atoi(optarg);
+				if (length <= 0)
+					rtfm("invalid sequence length: %s", optarg);
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind != argc)
+		rtfm("unexpected arguments");
+
+	/* The kernel may know about fewer capabilities than we do. */
+	int last = CAP_LAST_CAP;
+	FILE *f = fopen("/proc/sys/kernel/cap_last_cap", "re");
+	if (f) {
+		if (fscanf(f, "%d", &last) != 1 || last > CAP_LAST_CAP)
+			last = CAP_LAST_CAP;
+		fclose(f);
+	}
+	cap_mask = (1ULL << (last + 1)) - 1;
+
+	/* Otherwise the header would come out after the children's lines. */
+	printf("mapping\tsequences\tmismatches\n");
+	fflush(stdout);
+
+	int failed = run(false);
+	failed |= run(true);
+	return failed;
+}
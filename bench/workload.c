@@ -0,0 +1,203 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * workload.c is a set of small workloads that each stress a different
+ * part of remainroot: fork(2)/execve(2) (new tracees and exec handling),
+ * plain I/O (the cost of stopping at syscalls we don't shim), getuid(2)
+ * (the cheapest emulated syscall), setgroups(2) with large lists, and
+ * setuid(2) from a threaded process (which glibc broadcasts to every
+ * thread). Each one prints how long it took, in a machine-readable form.
+ *
+ * "command" just times another program, for workloads that are better
+ * done with existing tools (like extracting a tarball).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "common.h"
+
+static long iterations = 1000;
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [-n <iterations>] <workload> [<argument>]\n", __progname);
+	fprintf(stderr, "workloads: forkexec, io, getuid, setgroups <ngroups>, setuid-threads <nthreads>,\n");
+	fprintf(stderr, "           command <program> [<argument> ...]\n");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void forkexec(void)
+{
+	for (long i = 0; i < iterations; i++) {
+		pid_t pid = fork();
+		if (pid < 0)
+			die("fork failed: %m");
+		if (!pid) {
+			execl("/bin/true", "true", NULL);
+			_exit(127);
+		}
+		if (waitpid(pid, NULL, 0) < 0)
+			die("waitpid failed: %m");
+	}
+}
+
+static void io(void)
+{
+	char path[] = "/tmp/remainroot-bench.XXXXXX", buf[4096] = {0};
+
+	int fd = mkstemp(path);
+	if (fd < 0)
+		die("mkstemp failed: %m");
+	unlink(path);
+
+	for (long i = 0; i < iterations; i++) {
+		if (pwrite(fd, buf, sizeof(buf), (i % 256) * sizeof(buf)) != sizeof(buf))
+			die("pwrite failed: %m");
+		if (pread(fd, buf, sizeof(buf), (i % 256) * sizeof(buf)) != sizeof(buf))
+			die("pread failed: %m");
+	}
+	close(fd);
+}
+
+static void getuid_loop(void)
+{
+	for (long i = 0; i < iterations; i++)
+		syscall(SYS_getuid);
+}
+
+/* Unprivileged runs fail with EPERM, which still measures the round trip. */
+static void setgroups_loop(long ngroups)
+{
+	gid_t *groups = calloc(ngroups, sizeof(gid_t));
+	if (!groups)
+		die("calloc failed: %m");
+
+	/* Unsorted, so the emulation has to do the same work as the kernel. */
+	for (long i = 0; i < ngroups; i++)
+		groups[i] = (i * 7919) % 100000 + 1;
+
+	for (long i = 0; i < iterations; i++)
+		syscall(SYS_setgroups, ngroups, groups);
+	free(groups);
+}
+
+static pthread_barrier_t barrier;
+
+static void *idle_thread(void *arg)
+{
+	pthread_barrier_wait(&barrier);
+	return NULL;
+}
+
+static void setuid_threads(long nthreads)
+{
+	pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+	if (!threads)
+		die("calloc failed: %m");
+
+	pthread_barrier_init(&barrier, NULL, nthreads + 1);
+	for (long i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, idle_thread, NULL))
+			die("pthread_create failed");
+
+	/* glibc makes every thread do the setuid(2), so they all get traced. */
+	uid_t uid = getuid();
+	for (long i = 0; i < iterations; i++)
+		if (setuid(uid) < 0)
+			die("setuid failed: %m");
+
+	pthread_barrier_wait(&barrier);
+	for (long i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+static void command(char **argv)
+{
+	int status;
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		execvp(argv[0], argv);
+		die("exec(%s) failed: %m", argv[0]);
+	}
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		die("%s failed", argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "+n:h")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind >= argc)
+		rtfm("workload required");
+
+	const char *workload = argv[optind];
+	long arg = optind + 1 < argc ? atol(argv[optind + 1]) : 0;
+	double start = now();
+
+	if (!strcmp(workload, "forkexec"))
+		forkexec();
+	else if (!strcmp(workload, "io"))
+		io();
+	else if (!strcmp(workload, "getuid"))
+		getuid_loop();
+	else if (!strcmp(workload, "setgroups") && arg > 0)
+		setgroups_loop(arg);
+	else if (!strcmp(workload, "setuid-threads") && arg > 0)
+		setuid_threads(arg);
+	else if (!strcmp(workload, "command") && optind + 1 < argc)
+		command(argv + optind + 1);
+	else
+		rtfm("invalid workload: %s", workload);
+
+	printf("%.6f\n", now() - start);
+	return 0;
+}
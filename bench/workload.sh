@@ -0,0 +1,88 @@
+#!/bin/sh
+# remainroot: a shim to trick code to run in a rootless container
+# Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+#
+# remainroot is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# remainroot is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+
+
+# usage: workload.sh <remainroot> <bench-workload>
+#
+# Runs each workload natively and then under each remainroot engine (the
+# shim types in $ENGINES), and prints (as TSV) how long each run took and
+# its slowdown relative to the native run. Each run is repeated $RUNS
+# times and the fastest is kept, to cut down on noise.
+
+set -e
+
+REMAINROOT="$1"
+BENCH="$2"
+ENGINES="${ENGINES:-ptrace}"
+RUNS="${RUNS:-3}"
+TAR_FILES="${TAR_FILES:-5000}"
+
+tmp="$(mktemp -d)"
+trap 'rm -rf "$tmp"' EXIT
+
+# A tree of small files, owned by someone else so that extracting it as
+# (fake) root has to chown(2) everything.
+mkdir -p "$tmp/tree"
+i=0
+while [ "$i" -lt "$TAR_FILES" ]; do
+	dir="$tmp/tree/$((i / 100))"
+	[ -d "$dir" ] || mkdir "$dir"
+	echo "$i" >"$dir/$i"
+	i=$((i + 1))
+done
+tar -cf "$tmp/tree.tar" --owner=1000 --group=1000 -C "$tmp/tree" .
+mkdir "$tmp/out"
+
+# Prints the fastest of $RUNS runs of a workload, as "<name>\t<engine>\t<seconds>".
+run() {
+	name="$1"
+	engine="$2"
+	shift 2
+
+	best=
+	for _ in $(seq "$RUNS"); do
+		rm -rf "$tmp/out" && mkdir "$tmp/out"
+		if [ "$engine" = native ]; then
+			t="$("$BENCH" "$@")"
+		else
+			t="$("$REMAINROOT" -s "$engine" "$BENCH" "$@")"
+		fi
+		best="$(echo "$t $best" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')"
+	done
+	printf '%s\t%s\t%s\n' "$name" "$engine" "$best"
+}
+
+workload() {
+	name="$1"
+	shift
+	for engine in native $ENGINES; do
+		run "$name" "$engine" "$@"
+	done
+}
+
+{
+	workload forkexec -n 500 forkexec
+	workload io -n 100000 io
+	workload getuid -n 100000 getuid
+	workload setgroups-1000 -n 1000 setgroups 1000
+	workload setgroups-65536 -n 100 setgroups 65536
+	workload setuid-threads -n 1000 setuid-threads 16
+	workload tar -n 1 command tar -xf "$tmp/tree.tar" -C "$tmp/out"
+} | awk -F'\t' '
+	BEGIN { printf "workload\tengine\tseconds\tslowdown\n" }
+	$2 == "native" { native = $3 }
+	{ printf "%s\t%s\t%.6f\t%.2f\n", $1, $2, $3, (native > 0 ? $3 / native : 0) }'
@@ -39,11 +39,14 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/prctl.h>
 #include <syscall.h>
 #include <linux/securebits.h>
 
+#include "probes.h"
+
 /* Verify that we don't break the default prototypes. */
 #include "cred.h"
 
@@ -71,11 +74,7 @@
  * A close reading of the capability code in the kernel reveals that only
  * setuid-like syscalls will cause capabilities to be dropped. In that case,
  * all capabilities are dropped. All of this is controlled by securebits.
- */
-
-/*
- * TODO: Implement securebits handling (might need to intercept prctl(PR_GET_SECUREBITS))
- * TODO: Implement capabilities handling (hope this isn't necessary).
+ * The rules are in security/commoncap.c, which is what this mirrors.
  */
 
 #define issecure(current, x) ((1 << (x)) & (current)->securebits)
@@ -86,19 +85,27 @@
 #define SETID_RES 2
 #define SETID_FS  3
 
-void cred_drop_cap(struct cred_t *cred)
-{
-	cred->cap_setuid = false;
-	cred->cap_setgid = false;
-}
+#define CAP_FULL_SET ((1ULL << (CAP_LAST_CAP + 1)) - 1)
+
+/* The capabilities that are tied to fsuid == 0 (CAP_FS_SET in the kernel). */
+#define CAP_FS_MASK \
+	((1ULL << CAP_CHOWN) | (1ULL << CAP_MKNOD) | (1ULL << CAP_DAC_OVERRIDE) | \
+	 (1ULL << CAP_DAC_READ_SEARCH) | (1ULL << CAP_FOWNER) | (1ULL << CAP_FSETID) | \
+	 (1ULL << CAP_LINUX_IMMUTABLE) | (1ULL << CAP_MAC_OVERRIDE))
 
-void cred_raise_cap(struct cred_t *cred)
+/* Source of cred_t versions. */
+static unsigned long cred_generation;
+
+/* Replaces current with new, which has been modified. */
+static void cred_commit(struct cred_t *current, struct cred_t *new)
 {
-	/* TODO: Implement the different capability sets. */
+	cred_clone(current, new);
+	current->version = ++cred_generation;
+	PROBE5(cred__commit, current->version, current->uid, current->euid, current->gid, current->egid);
 }
 
-/* Emulates old GNU/Linux semantics, based on securebits. */
-void cred_emulate_setxuid(struct cred_t *new, struct cred_t *old)
+/* Mirrors cap_emulate_setxuid(). */
+static void cred_emulate_setxuid(struct cred_t *new, struct cred_t *old)
 {
 	/*
 	 * We only have to drop all capabilities here if we went from having some
@@ -106,18 +113,22 @@ void cred_emulate_setxuid(struct cred_t *new, struct cred_t *old)
 	 */
 	if ((old->uid == 0 || old->euid == 0 || old->suid == 0) &&
 		(new->uid != 0 && new->euid != 0 && new->suid != 0)) {
-		if (!issecure(old, SECURE_KEEP_CAPS))
-			cred_drop_cap(new);
+		if (!issecure(old, SECURE_KEEP_CAPS)) {
+			new->cap_permitted = 0;
+			new->cap_effective = 0;
+		}
+		/* Programs from before ambient capabilities expect this to drop everything. */
+		new->cap_ambient = 0;
 	}
 
-	if (old->euid == 0 && old->euid != 0)
-		cred_drop_cap(new);
-	if (old->euid != 0 && old->euid == 0)
-		cred_raise_cap(new);
+	if (old->euid == 0 && new->euid != 0)
+		new->cap_effective = 0;
+	if (old->euid != 0 && new->euid == 0)
+		new->cap_effective = new->cap_permitted;
 }
 
 /* Fixes up credentials based on securebits. */
-int cred_fix_capabilities(struct cred_t *new, struct cred_t *old, int flags)
+static int cred_fix_capabilities(struct cred_t *new, struct cred_t *old, int flags)
 {
 	switch (flags) {
 	case SETID_RE:
@@ -127,12 +138,11 @@ int cred_fix_capabilities(struct cred_t *new, struct cred_t *old, int flags)
 			cred_emulate_setxuid(new, old);
 		break;
 	case SETID_FS:
-		/* XXX: We don't support any of the capabilities changed here. */
 		if (!issecure(old, SECURE_NO_SETUID_FIXUP)) {
 			if (old->fsuid == 0 && new->fsuid != 0)
-				/*cred_drop_fscap(new)*/;
+				new->cap_effective &= ~CAP_FS_MASK;
 			if (old->fsuid != 0 && new->fsuid == 0)
-				/*cred_raise_fscap(new)*/;
+				new->cap_effective |= new->cap_permitted & CAP_FS_MASK;
 		}
 		break;
 
@@ -155,7 +165,10 @@ int __rr_do_setuid(struct cred_t *current, uid_t uid)
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (current->cap_setuid)
+	if (uid == (uid_t) -1)
+		return -EINVAL;
+
+	if (cred_capable(current, CAP_SETUID))
 		new.uid = new.euid = new.suid = uid;
 	else if (uid == current->uid || uid == current->suid)
 		new.euid = uid;
@@ -164,7 +177,7 @@ int __rr_do_setuid(struct cred_t *current, uid_t uid)
 
 	new.fsuid = new.euid;
 	cred_fix_capabilities(&new, current, SETID_ID);
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -178,17 +191,20 @@ uid_t __rr_do_getuid(struct cred_t *current)
 
 int __rr_do_setfsuid(struct cred_t *current, uid_t fsuid)
 {
-	uid_t old_fsuid = fsuid;
+	uid_t old_fsuid = current->fsuid;
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setuid)
+	if (fsuid == (uid_t) -1)
+		goto error;
+
+	if (!cred_capable(current, CAP_SETUID))
 		if (!BSD_UID_ACCESS(current, fsuid, true) && fsuid != current->fsuid)
 			goto error;
 
 	new.fsuid = fsuid;
 	cred_fix_capabilities(&new, current, SETID_FS);
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	/* fallthrough */
 
 error:
@@ -200,7 +216,7 @@ int __rr_do_setreuid(struct cred_t *current, uid_t ruid, uid_t euid)
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setuid) {
+	if (!cred_capable(current, CAP_SETUID)) {
 		if (!BSD_UID_ACCESS(current, ruid, false))
 			goto error;
 		if (!BSD_UID_ACCESS(current, euid, true))
@@ -216,7 +232,7 @@ int __rr_do_setreuid(struct cred_t *current, uid_t ruid, uid_t euid)
 
 	new.fsuid = new.euid;
 	cred_fix_capabilities(&new, current, SETID_RE);
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -230,7 +246,13 @@ int __rr_do_setresuid(struct cred_t *current, uid_t ruid, uid_t euid, uid_t suid
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setuid) {
+	/* Like the kernel, don't even reset fsuid if nothing would change. */
+	if ((ruid == (uid_t) -1 || ruid == current->uid) &&
+	    (euid == (uid_t) -1 || (euid == current->euid && euid == current->fsuid)) &&
+	    (suid == (uid_t) -1 || suid == current->suid))
+		return 0;
+
+	if (!cred_capable(current, CAP_SETUID)) {
 		if (!BSD_UID_ACCESS(current, ruid, true))
 			goto error;
 		if (!BSD_UID_ACCESS(current, euid, true))
@@ -248,7 +270,7 @@ int __rr_do_setresuid(struct cred_t *current, uid_t ruid, uid_t euid, uid_t suid
 
 	new.fsuid = new.euid;
 	cred_fix_capabilities(&new, current, SETID_RES);
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -300,15 +322,18 @@ int __rr_do_setgid(struct cred_t *current, gid_t gid)
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (current->cap_setgid)
+	if (gid == (gid_t) -1)
+		return -EINVAL;
+
+	if (cred_capable(current, CAP_SETGID))
 		new.gid = new.egid = new.sgid = gid;
 	else if (gid == current->gid || gid == current->sgid)
 		new.egid = gid;
 	else
 		goto error;
 
-	current->fsgid = current->egid;
-	cred_clone(current, &new);
+	new.fsgid = new.egid;
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -322,16 +347,19 @@ gid_t __rr_do_getgid(struct cred_t *current)
 
 int __rr_do_setfsgid(struct cred_t *current, gid_t fsgid)
 {
-	gid_t old_fsgid = fsgid;
+	gid_t old_fsgid = current->fsgid;
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setgid)
+	if (fsgid == (gid_t) -1)
+		goto error;
+
+	if (!cred_capable(current, CAP_SETGID))
 		if (!BSD_GID_ACCESS(current, fsgid, true) && fsgid != current->fsgid)
 			goto error;
 
 	new.fsgid = fsgid;
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	/* fallthrough */
 
 error:
@@ -343,7 +371,7 @@ int __rr_do_setregid(struct cred_t *current, gid_t rgid, gid_t egid)
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setgid) {
+	if (!cred_capable(current, CAP_SETGID)) {
 		if (!BSD_GID_ACCESS(current, rgid, false))
 			goto error;
 		if (!BSD_GID_ACCESS(current, egid, true))
@@ -358,7 +386,7 @@ int __rr_do_setregid(struct cred_t *current, gid_t rgid, gid_t egid)
 		new.sgid = new.egid;
 
 	new.fsgid = new.egid;
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -372,7 +400,13 @@ int __rr_do_setresgid(struct cred_t *current, gid_t rgid, gid_t egid, gid_t sgid
 	struct cred_t new;
 	cred_clone(&new, current);
 
-	if (!current->cap_setgid) {
+	/* Like the kernel, don't even reset fsgid if nothing would change. */
+	if ((rgid == (gid_t) -1 || rgid == current->gid) &&
+	    (egid == (gid_t) -1 || (egid == current->egid && egid == current->fsgid)) &&
+	    (sgid == (gid_t) -1 || sgid == current->sgid))
+		return 0;
+
+	if (!cred_capable(current, CAP_SETGID)) {
 		if (!BSD_GID_ACCESS(current, rgid, true))
 			goto error;
 		if (!BSD_GID_ACCESS(current, egid, true))
@@ -389,7 +423,7 @@ int __rr_do_setresgid(struct cred_t *current, gid_t rgid, gid_t egid, gid_t sgid
 		new.sgid = sgid;
 
 	new.fsgid = new.egid;
-	cred_clone(current, &new);
+	cred_commit(current, &new);
 	return 0;
 
 error:
@@ -430,22 +464,35 @@ gid_t __rr_do_getegid(struct cred_t *current)
  * version rootless container.
  */
 
-int __rr_do_setgroups(struct cred_t *current, int size, const gid_t *list)
+static int gid_cmp(const void *a, const void *b)
 {
-	struct cred_t new;
-	cred_clone(&new, current);
+	gid_t x = *(const gid_t *) a, y = *(const gid_t *) b;
+	return (x > y) - (x < y);
+}
 
-	if (size <= 0 || size > NGROUPS_MAX)
+/* Mirrors groups_sort() in kernel/groups.c. */
+static void groups_sort(gid_t *groups, int ngroups)
+{
+	qsort(groups, ngroups, sizeof(gid_t), gid_cmp);
+}
+
+int __rr_do_setgroups(struct cred_t *current, int size, const gid_t *list)
+{
+	if (size < 0 || size > NGROUPS_MAX)
 		goto error_value;
 
-	if (!current->cap_setgid)
+	if (!cred_capable(current, CAP_SETGID))
 		goto error_perm;
 
+	/*
+	 * No other fields change, so there's no need to go through a copy of
+	 * the (rather large) cred_t.
+	 */
 	for (int i = 0; i < size; i++)
-		new.groups[i] = list[i];
-
-	new.ngroups = size;
-	cred_clone(current, &new);
+		current->groups[i] = list[i];
+	current->ngroups = size;
+	groups_sort(current->groups, size);
+	current->version = ++cred_generation;
 	return 0;
 
 error_value:
@@ -475,6 +522,288 @@ error:
 	return -EINVAL;
 }
 
+/**************************************************************
+ * This section implements all of the capability-based shims. *
+ **************************************************************/
+
+/*
+ * Mirrors cap_validate_magic(), returning how many cap_user_data_t
+ * structs (of 32 bits each) the caller is using. Unknown versions get the
+ * version we'd prefer written back.
+ */
+static int cap_validate_magic(cap_user_header_t header, int *words)
+{
+	switch (header->version) {
+		case _LINUX_CAPABILITY_VERSION_1:
+			*words = _LINUX_CAPABILITY_U32S_1;
+			return 0;
+		case _LINUX_CAPABILITY_VERSION_2:
+		case _LINUX_CAPABILITY_VERSION_3:
+			*words = _LINUX_CAPABILITY_U32S_3;
+			return 0;
+	}
+
+	header->version = _LINUX_CAPABILITY_VERSION_3;
+	return -EINVAL;
+}
+
+/*
+ * header->pid is ignored here, it's up to the shim to pass the right
+ * process's credentials as current.
+ */
+int __rr_do_capget(struct cred_t *current, cap_user_header_t header, cap_user_data_t data)
+{
+	int words;
+
+	int err = cap_validate_magic(header, &words);
+	if (!data || err < 0)
+		return !data && err == -EINVAL ? 0 : err;
+	if (header->pid < 0)
+		return -EINVAL;
+
+	for (int i = 0; i < words; i++) {
+		data[i].effective = current->cap_effective >> (32 * i);
+		data[i].permitted = current->cap_permitted >> (32 * i);
+		data[i].inheritable = current->cap_inheritable >> (32 * i);
+	}
+	return 0;
+}
+
+/* Mirrors capset() and cap_capset(). */
+int __rr_do_capset(struct cred_t *current, cap_user_header_t header, const cap_user_data_t data)
+{
+	uint64_t effective = 0, permitted = 0, inheritable = 0;
+	int words;
+
+	int err = cap_validate_magic(header, &words);
+	if (err < 0)
+		return err;
+
+	/* You can only set your own capabilities. */
+	if (header->pid != 0 && header->pid != getpid())
+		return -EPERM;
+
+	for (int i = 0; i < words; i++) {
+		effective |= (uint64_t) data[i].effective << (32 * i);
+		permitted |= (uint64_t) data[i].permitted << (32 * i);
+		inheritable |= (uint64_t) data[i].inheritable << (32 * i);
+	}
+	effective &= CAP_FULL_SET;
+	permitted &= CAP_FULL_SET;
+	inheritable &= CAP_FULL_SET;
+
+	/* Inheritable can only grow into permitted, unless you have CAP_SETPCAP. */
+	if (inheritable & ~(current->cap_inheritable | current->cap_permitted) &&
+	    !cred_capable(current, CAP_SETPCAP))
+		goto error_perm;
+	/* But never past the bounding set. */
+	if (inheritable & ~(current->cap_inheritable | current->cap_bset))
+		goto error_perm;
+	/* Permitted can only shrink, and effective has to be a subset of it. */
+	if (permitted & ~current->cap_permitted)
+		goto error_perm;
+	if (effective & ~permitted)
+		goto error_perm;
+
+	struct cred_t new;
+	cred_clone(&new, current);
+	new.cap_effective = effective;
+	new.cap_permitted = permitted;
+	new.cap_inheritable = inheritable;
+	new.cap_ambient &= permitted & inheritable;
+	cred_commit(current, &new);
+	return 0;
+
+error_perm:
+	return -EPERM;
+}
+
+bool cred_prctl_option(int option)
+{
+	switch (option) {
+		case PR_CAPBSET_READ:
+		case PR_CAPBSET_DROP:
+		case PR_CAP_AMBIENT:
+		case PR_GET_KEEPCAPS:
+		case PR_SET_KEEPCAPS:
+		case PR_GET_SECUREBITS:
+		case PR_SET_SECUREBITS:
+		case PR_REMAINROOT_NEW_DOMAIN:
+			return true;
+	}
+	return false;
+}
+
+/* Mirrors cap_task_prctl() (and prctl_set_securebits, which is in there too). */
+int cred_prctl(struct cred_t *current, int option, unsigned long arg2, unsigned long arg3,
+               unsigned long arg4, unsigned long arg5)
+{
+	struct cred_t new;
+
+	switch (option) {
+		case PR_CAPBSET_READ:
+			if (!cap_valid(arg2))
+				return -EINVAL;
+			return !!(current->cap_bset & (1ULL << arg2));
+
+		case PR_CAPBSET_DROP:
+			if (!cred_capable(current, CAP_SETPCAP))
+				return -EPERM;
+			if (!cap_valid(arg2))
+				return -EINVAL;
+
+			cred_clone(&new, current);
+			new.cap_bset &= ~(1ULL << arg2);
+			cred_commit(current, &new);
+			return 0;
+
+		case PR_CAP_AMBIENT:
+			if (arg2 == PR_CAP_AMBIENT_CLEAR_ALL) {
+				if (arg3 | arg4 | arg5)
+					return -EINVAL;
+
+				cred_clone(&new, current);
+				new.cap_ambient = 0;
+				cred_commit(current, &new);
+				return 0;
+			}
+
+			if (((!cap_valid(arg3)) | arg4 | arg5))
+				return -EINVAL;
+
+			if (arg2 == PR_CAP_AMBIENT_IS_SET)
+				return !!(current->cap_ambient & (1ULL << arg3));
+			if (arg2 != PR_CAP_AMBIENT_RAISE && arg2 != PR_CAP_AMBIENT_LOWER)
+				return -EINVAL;
+
+			cred_clone(&new, current);
+			if (arg2 == PR_CAP_AMBIENT_LOWER) {
+				new.cap_ambient &= ~(1ULL << arg3);
+			} else {
+				if (!(current->cap_permitted & current->cap_inheritable & (1ULL << arg3)) ||
+				    issecure(current, SECURE_NO_CAP_AMBIENT_RAISE))
+					return -EPERM;
+				new.cap_ambient |= 1ULL << arg3;
+			}
+			cred_commit(current, &new);
+			return 0;
+
+		case PR_GET_KEEPCAPS:
+			return !!issecure(current, SECURE_KEEP_CAPS);
+
+		case PR_SET_KEEPCAPS:
+			if (arg2 > 1)
+				return -EINVAL;
+			if (issecure(current, SECURE_KEEP_CAPS_LOCKED))
+				return -EPERM;
+
+			cred_clone(&new, current);
+			if (arg2)
+				new.securebits |= issecure_mask(SECURE_KEEP_CAPS);
+			else
+				new.securebits &= ~issecure_mask(SECURE_KEEP_CAPS);
+			cred_commit(current, &new);
+			return 0;
+
+		case PR_GET_SECUREBITS:
+			return current->securebits;
+
+		case PR_SET_SECUREBITS:
+			/* Locked bits can't be changed, and locks can't be released. */
+			if (((current->securebits & SECURE_ALL_LOCKS) >> 1) & (current->securebits ^ arg2))
+				return -EPERM;
+			if (current->securebits & SECURE_ALL_LOCKS & ~arg2)
+				return -EPERM;
+			if (arg2 & ~(SECURE_ALL_LOCKS | SECURE_ALL_BITS))
+				return -EPERM;
+			if (!cred_capable(current, CAP_SETPCAP))
+				return -EPERM;
+
+			cred_clone(&new, current);
+			new.securebits = arg2;
+			cred_commit(current, &new);
+			return 0;
+
+		case PR_REMAINROOT_NEW_DOMAIN:
+			if (arg2 | arg3 | arg4 | arg5)
+				return -EINVAL;
+			if (!cred_capable(current, CAP_SETUID) || !cred_capable(current, CAP_SETGID))
+				return -EPERM;
+
+			/*
+			 * Root, but only with what root could get back by exec(2)ing: the
+			 * bounding set, groups and securebits (locked or not) all stay.
+			 * no_new_privs is the kernel's, so it stays as well.
+			 */
+			cred_clone(&new, current);
+			new.uid = new.euid = new.suid = new.fsuid = 0;
+			new.gid = new.egid = new.sgid = new.fsgid = 0;
+			new.cap_permitted = new.cap_effective = current->cap_bset;
+			new.cap_ambient = 0;
+			cred_commit(current, &new);
+			return 0;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Mirrors bprm_fill_uid() and cap_bprm_creds_from_file(). Set-id bits
+ * change the effective ids, file capabilities are applied against the
+ * inheritable and bounding sets, and root gets everything in the bounding
+ * set (unless SECURE_NOROOT is set, or this is a set-uid-root file with
+ * file capabilities). Everyone else only keeps the ambient set.
+ *
+ * XXX: We can't set AT_SECURE for privileged execs (the auxv has already
+ *      been written by the time we find out), nor fail the execve(2) with
+ *      -EPERM for files whose forced capabilities can't all be granted.
+ */
+void cred_exec(struct cred_t *cred, const struct cred_bprm_t *bprm)
+{
+	struct cred_t new;
+	cred_clone(&new, cred);
+
+	if (!bprm->no_new_privs) {
+		if (bprm->setuid)
+			new.euid = bprm->uid;
+		if (bprm->setgid)
+			new.egid = bprm->gid;
+	}
+
+	bool effective = false;
+	new.cap_permitted = 0;
+	if (bprm->fcaps) {
+		effective = bprm->fcaps_effective;
+		new.cap_permitted = (cred->cap_bset & bprm->fcaps_permitted) |
+		                    (cred->cap_inheritable & bprm->fcaps_inheritable);
+	}
+
+	bool suid_root = new.uid != 0 && new.euid == 0;
+	if (!issecure(cred, SECURE_NOROOT) && !(bprm->fcaps && suid_root)) {
+		if (new.uid == 0 || new.euid == 0)
+			new.cap_permitted = cred->cap_bset | cred->cap_inheritable;
+		if (new.euid == 0)
+			effective = true;
+	}
+
+	/* Nothing can be gained under no_new_privs. */
+	if (bprm->no_new_privs)
+		new.cap_permitted &= cred->cap_permitted;
+
+	new.suid = new.fsuid = new.euid;
+	new.sgid = new.fsgid = new.egid;
+
+	bool setid = new.euid != cred->uid || new.egid != cred->gid;
+	if (bprm->fcaps || setid)
+		new.cap_ambient = 0;
+
+	new.cap_permitted |= new.cap_ambient;
+	new.cap_effective = effective ? new.cap_permitted : new.cap_ambient;
+
+	new.securebits &= ~issecure_mask(SECURE_KEEP_CAPS);
+	cred_commit(cred, &new);
+}
+
 /* TODO: Actually get this from /proc/sys/kernel/overflowgid. */
 #define OVERFLOW_GID 65534
 
@@ -488,17 +817,19 @@ void cred_new(struct cred_t *current)
 	 * priviliges.
 	 */
 	*current = (struct cred_t) {
-		.cap_setuid = true,
-		.uid        = 0,
-		.euid       = 0,
-		.suid       = 0,
-		.fsuid      = 0,
-		.cap_setgid = true,
-		.gid        = 0,
-		.egid       = 0,
-		.sgid       = 0,
-		.fsgid      = 0,
-		.securebits = prctl(PR_GET_SECUREBITS),
+		.uid           = 0,
+		.euid          = 0,
+		.suid          = 0,
+		.fsuid         = 0,
+		.gid           = 0,
+		.egid          = 0,
+		.sgid          = 0,
+		.fsgid         = 0,
+		.securebits    = prctl(PR_GET_SECUREBITS),
+		.cap_permitted = CAP_FULL_SET,
+		.cap_effective = CAP_FULL_SET,
+		.cap_bset      = CAP_FULL_SET,
+		.version       = ++cred_generation,
 	};
 
 	/* Set up supplementary groups. */
@@ -514,9 +845,36 @@ void cred_new(struct cred_t *current)
 		if (groups[i] != OVERFLOW_GID)
 			current->groups[current->ngroups++] = groups[i];
 	}
+	groups_sort(current->groups, current->ngroups);
 }
 
 void cred_clone(struct cred_t *new, struct cred_t *old)
 {
 	*new = *old;
 }
+
+/*
+ * This is run for every emulated permission check, and some accounts have
+ * hundreds of groups. The search is branchless (the halving step compiles
+ * to a cmov), so it doesn't pay for a mispredict on every level.
+ */
+bool cred_has_group(struct cred_t *cred, gid_t gid)
+{
+	const gid_t *base = cred->groups;
+	int n = cred->ngroups;
+
+	if (!n)
+		return false;
+
+	while (n > 1) {
+		int half = n / 2;
+		base = base[half - 1] < gid ? base + half : base;
+		n -= half;
+	}
+	return *base == gid;
+}
+
+bool cred_in_group(struct cred_t *cred, gid_t gid)
+{
+	return gid == cred->fsgid || cred_has_group(cred, gid);
+}
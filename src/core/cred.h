@@ -19,39 +19,106 @@
 #if !defined(REMAINROOT_CRED_H) || defined(SYSCALL0) || defined(LIBCALL0)
 #include <sys/types.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
+#include <linux/capability.h>
 
 #if !defined(REMAINROOT_CRED_H)
 #define REMAINROOT_CRED_H
 
 /* This effectively mirrors the cred structure in the Linux kernel. */
 struct cred_t {
-	bool cap_setuid;
 	uid_t uid,
 		  euid,
 		  suid,
 		  fsuid;
 
-	bool cap_setgid;
 	gid_t gid,
 		  egid,
 		  sgid,
 		  fsgid;
 
+	/* Kept sorted (like the kernel does), so they can be binary searched. */
 	int ngroups;
 	gid_t groups[NGROUPS_MAX];
 
 	long securebits;
 
-	/* TODO: Capabilities support. */
+	/* Capability sets, as bitmasks of CAP_TO_MASK(cap). */
+	uint64_t cap_inheritable,
+			 cap_permitted,
+			 cap_effective,
+			 cap_bset,
+			 cap_ambient;
+
+	/*
+	 * Changes every time the credentials do, so anything derived from
+	 * them can be cached. Copies made by cred_clone share the version.
+	 */
+	unsigned long version;
 };
 
+/* Whether cap is in the effective set (i.e. capable(cap) in the kernel). */
+static inline bool cred_capable(struct cred_t *cred, int cap)
+{
+	return cred->cap_effective & (1ULL << cap);
+}
+
 /* Initiates a new cred_t with the current process context. */
 void cred_new(struct cred_t *cred);
 
 /* Clones a cred_t, so it can be used for another process */
 void cred_clone(struct cred_t *new, struct cred_t *old);
 
+/*
+ * Emulates the credential-related prctl(2) options. cred_prctl_option
+ * says whether option is one of those, since prctl(2) is used for plenty
+ * of other things that should be left to the kernel.
+ */
+bool cred_prctl_option(int option);
+
+/*
+ * A prctl(2) option the kernel doesn't have, which a nested remainroot uses
+ * to ask the one tracing it for new (root) credentials, rather than tracing
+ * its program itself. Only a process that could become any uid and gid
+ * anyway (with CAP_SETUID and CAP_SETGID) may do it, and it only gets the
+ * capabilities left in its bounding set. Its groups and securebits are
+ * kept. Real kernels fail it with EINVAL.
+ */
+#define PR_REMAINROOT_NEW_DOMAIN 0x52520001
+
+int cred_prctl(struct cred_t *current, int option, unsigned long arg2, unsigned long arg3,
+               unsigned long arg4, unsigned long arg5);
+
+/*
+ * What the file being execve(2)d grants (see file_exec). The ids are only
+ * meaningful if the corresponding set-id bit is set, and the capabilities
+ * if the file has a security.capability xattr.
+ */
+struct cred_bprm_t {
+	bool setuid;
+	bool setgid;
+	uid_t uid;
+	gid_t gid;
+
+	bool fcaps;
+	bool fcaps_effective;
+	uint64_t fcaps_permitted;
+	uint64_t fcaps_inheritable;
+
+	/* PR_SET_NO_NEW_PRIVS stops the file from granting anything. */
+	bool no_new_privs;
+};
+
+/* Transforms the credentials as execve(2) does, for the file described by bprm. */
+void cred_exec(struct cred_t *cred, const struct cred_bprm_t *bprm);
+
+/* Checks whether gid is one of the supplementary groups. */
+bool cred_has_group(struct cred_t *cred, gid_t gid);
+
+/* Checks whether gid is the fsgid or one of the supplementary groups. */
+bool cred_in_group(struct cred_t *cred, gid_t gid);
+
 #endif /* !defined(REMAINROOT_CRED_H) */
 
 /* TODO: Separate all of this into a separate header. */
@@ -83,6 +150,10 @@ SYSCALL0(gid_t, getegid)
 SYSCALL2(int, setgroups, int, size, const gid_t *, list)
 SYSCALL2(int, getgroups, int, size, gid_t *, list)
 
+/* Shims for capabilities. */
+SYSCALL2(int, capget, cap_user_header_t, header, cap_user_data_t, data)
+SYSCALL2(int, capset, cap_user_header_t, header, const cap_user_data_t, data)
+
 /* Clean up. */
 #include "syscalls-undef.h"
 
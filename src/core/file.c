@@ -29,6 +29,985 @@
  * In addition, many of the caveats in cred.c apply to this set of
  * shims. Luckily, there isn't such a trivial bypass in /proc (in
  * contrast to /proc/self/status).
+ *
+ * The "simple way" is an overlay: every inode that has been chown(2)ed
+ * gets an entry in an inode table (see inode.c), keyed by {dev, ino}.
+ * Inodes that aren't in the table are reported as-is. Since inode
+ * numbers get reused, the shim has to tell us when an inode has been
+ * removed (see file_forget). The table can be backed by a state file
+ * (see file_open_state), so that ownership survives across runs.
+ *
+ * Alternatively, ownership can be stored in the user.rootlesscontainers
+ * xattr of each file, which is the convention used by other rootless
+ * container tools (umoci, runROOTLESS, ...). In that case the inode table
+ * is a cache of decoded xattrs (including ones that don't exist), so each
+ * file's xattr is only read once, unless a tracee changes it. The cache is
+ * never kept in a state file.
+ *
+ * security.* xattrs (file capabilities and LSM labels) can't be set
+ * without privileges either, so those are faked as well. There are far
+ * fewer of them, so they're kept per-inode in an ohmic map rather than in
+ * the inode table (which only has a flag to say that there are any).
+ *
+ * A daemon worker (see ptrace/daemon.c) traces lots of unrelated
+ * containers, which mustn't see each other's faked metadata. So all of the
+ * above lives in a file_domain_t, and each container gets a domain of its
+ * own. The tracer picks the domain of whichever tracee it is dealing with
+ * before calling in here.
+ *
+ * XXX: Processes outside of our control (or the host) can still change
+ *      the real owner of a file, and we'll happily keep lying about it.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+#include <linux/capability.h>
+#include <linux/securebits.h>
+
+#include "common.h"
+#include "ohmic/ohmic.h"
+#include "core/cred.h"
+#include "core/inode.h"
+
+/* Verify that we don't break the default prototypes. */
+#include "core/file.h"
+
+/* The table should be able to fit a reasonably large rootfs without resizing. */
+#define FILE_TABLE_HINT (1 << 16)
+
+/* Everything we fake about files, for one domain (see file_domain_new). */
+struct file_domain_t {
+	struct inode_table_t inodes;
+
+	/* {dev, ino} -> packed list of faked security.* xattrs. */
+	struct ohm_t *xattrs;
+
+	/* {dev, ino} -> exec_entry_t, for files that have been execve(2)d. */
+	struct ohm_t *execs;
+
+	unsigned int refs;
+};
+
+/* The domain that isn't anyone's in particular, and the one in use. */
+static struct file_domain_t root_domain, *files = &root_domain;
+
+/* Whether ownership is stored in user.rootlesscontainers (see file_use_xattr). */
+static bool use_xattr;
+
+/*
+ * Only the process that set up the table gets to tear it down. Otherwise a
+ * forked child that exits (rather than exec(2)ing) would compact the state
+ * file from underneath us.
+ */
+static pid_t table_owner;
+
+static void file_domain_init(struct file_domain_t *domain, size_t hint)
+{
+	if (inode_table_init(&domain->inodes, hint) < 0)
+		die("inode_table_init failed: %m");
+	domain->xattrs = ohm_init(1024, ohm_hash);
+	domain->execs = ohm_init(256, ohm_hash);
+	if (!domain->xattrs || !domain->execs)
+		die("file_domain_init: out of memory");
+}
+
+static void file_domain_free(struct file_domain_t *domain)
+{
+	inode_table_free(&domain->inodes);
+	ohm_free(domain->xattrs);
+	ohm_free(domain->execs);
+}
+
+static void file_init(void) __attribute__((constructor));
+static void file_init(void)
+{
+	table_owner = getpid();
+	file_domain_init(&root_domain, FILE_TABLE_HINT);
+}
+
+static void xattr_purge(void);
+
+static void file_exit(void) __attribute__((destructor));
+static void file_exit(void)
+{
+	if (getpid() != table_owner)
+		return;
+
+	files = &root_domain;
+	if (files->inodes.path && use_xattr)
+		xattr_purge();
+	if (files->inodes.path && inode_table_compact(&files->inodes) < 0)
+		warn("compacting state file %s failed: %m", files->inodes.path);
+	file_domain_free(&root_domain);
+}
+
+void file_open_state(const char *path)
+{
+	struct inode_table_t state;
+
+	if (inode_table_open(&state, path, FILE_TABLE_HINT) < 0)
+		die("couldn't open state file %s: %m", path);
+
+	inode_table_free(&root_domain.inodes);
+	root_domain.inodes = state;
+	table_owner = getpid();
+}
+
+/* The domains of daemon containers are only ever in memory, so they start small. */
+#define DOMAIN_TABLE_HINT 1024
+
+struct file_domain_t *file_domain_new(void)
+{
+	struct file_domain_t *domain = calloc(1, sizeof(*domain));
+	if (!domain)
+		die("file_domain_new: out of memory");
+	file_domain_init(domain, DOMAIN_TABLE_HINT);
+	domain->refs = 1;
+	return domain;
+}
+
+void file_domain_get(struct file_domain_t *domain)
+{
+	if (domain)
+		domain->refs++;
+}
+
+void file_domain_put(struct file_domain_t *domain)
+{
+	if (!domain || --domain->refs)
+		return;
+	if (files == domain)
+		files = &root_domain;
+	file_domain_free(domain);
+	free(domain);
+}
+
+void file_domain_use(struct file_domain_t *domain)
+{
+	files = domain ? domain : &root_domain;
+}
+
+/**********************************************************************
+ * This section implements the user.rootlesscontainers xattr storage. *
+ **********************************************************************/
+
+void file_use_xattr(void)
+{
+	use_xattr = true;
+	if (root_domain.inodes.path)
+		xattr_purge();
+}
+
+/*
+ * The xattr is a protobuf message:
+ *
+ *   message Resource {
+ *     uint32 uid = 1;
+ *     uint32 gid = 2;
+ *   }
+ *
+ * Fields that are unset are 0 (as with any proto3 field), while NOOP_ID
+ * means that the real owner should be used. We only need to deal with
+ * varints, and only have to skip over fields we don't understand.
+ */
+#define XATTR_NAME "user.rootlesscontainers"
+#define XATTR_MAX  64
+#define NOOP_ID    UINT32_MAX
+
+static size_t varint_put(uint8_t *buf, uint64_t value)
+{
+	size_t n = 0;
+
+	do {
+		buf[n] = value & 0x7f;
+		value >>= 7;
+		if (value)
+			buf[n] |= 0x80;
+		n++;
+	} while (value);
+	return n;
+}
+
+static ssize_t varint_get(const uint8_t *buf, size_t len, uint64_t *value)
+{
+	*value = 0;
+	for (size_t n = 0; n < len && n < 10; n++) {
+		*value |= (uint64_t) (buf[n] & 0x7f) << (7 * n);
+		if (!(buf[n] & 0x80))
+			return n + 1;
+	}
+	return -1;
+}
+
+static size_t xattr_encode(uint8_t *buf, uint32_t uid, uint32_t gid)
+{
+	size_t n = 0;
+
+	if (uid) {
+		buf[n++] = (1 << 3) | 0;
+		n += varint_put(buf + n, uid);
+	}
+	if (gid) {
+		buf[n++] = (2 << 3) | 0;
+		n += varint_put(buf + n, gid);
+	}
+	return n;
+}
+
+static int xattr_decode(const uint8_t *buf, size_t len, uint32_t *uid, uint32_t *gid)
+{
+	*uid = *gid = 0;
+
+	for (size_t n = 0; n < len;) {
+		uint64_t key, value;
+		ssize_t m;
+
+		if ((m = varint_get(buf + n, len - n, &key)) < 0)
+			return -1;
+		n += m;
+
+		switch (key & 7) {
+			case 0: /* varint */
+				if ((m = varint_get(buf + n, len - n, &value)) < 0)
+					return -1;
+				n += m;
+				if (key >> 3 == 1)
+					*uid = value;
+				else if (key >> 3 == 2)
+					*gid = value;
+				break;
+			case 1: /* 64-bit */
+				if (len - n < 8)
+					return -1;
+				n += 8;
+				break;
+			case 2: /* length-delimited */
+				if ((m = varint_get(buf + n, len - n, &value)) < 0)
+					return -1;
+				n += m;
+				/* Anyone can set this on their own files, so don't trust it. */
+				if (value > len - n)
+					return -1;
+				n += value;
+				break;
+			case 5: /* 32-bit */
+				if (len - n < 4)
+					return -1;
+				n += 4;
+				break;
+			default:
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Reads the xattr into the inode (which is treated as a cache entry). */
+static void xattr_load(struct inode_t *inode, const char *path, bool follow)
+{
+	uint8_t buf[XATTR_MAX];
+	uint32_t uid, gid;
+
+	inode->flags |= INODE_XATTR;
+
+	ssize_t len = (follow ? getxattr : lgetxattr)(path, XATTR_NAME, buf, sizeof(buf));
+	if (len < 0 || xattr_decode(buf, len, &uid, &gid) < 0)
+		return;
+
+	if (uid != NOOP_ID) {
+		inode->uid = uid;
+		inode->flags |= INODE_UID;
+	}
+	if (gid != NOOP_ID) {
+		inode->gid = gid;
+		inode->flags |= INODE_GID;
+	}
+}
+
+/*
+ * Drops everything that was loaded from an inode's xattr, so that it's
+ * read again the next time it's needed.
+ */
+static void xattr_uncache(struct inode_t *inode)
+{
+	inode->flags &= ~(INODE_XATTR | INODE_UID | INODE_GID);
+	if (inode->flags == INODE_USED)
+		inode_remove(&files->inodes, inode->dev, inode->ino);
+}
+
+/*
+ * The xattrs can change between runs (that's the point of them), so what
+ * we cached from them mustn't be kept in a state file. Removing an entry
+ * can shift a later one into its slot, so the slot is looked at again.
+ */
+static void xattr_purge(void)
+{
+	for (size_t i = 0; i < files->inodes.size;) {
+		struct inode_t *inode = &files->inodes.entries[i];
+		if (inode->flags & INODE_XATTR)
+			xattr_uncache(inode);
+		else
+			i++;
+	}
+}
+
+/*
+ * Writes the inode's owner to the xattr. Since the inode is a cache of the
+ * xattr's contents, we can skip writing it if nothing changed (which is
+ * common: tar and dpkg chown(2) files they just created as the owner they
+ * were created as, and many tools will chown(2) the same file repeatedly).
+ */
+static void xattr_store(struct inode_t *inode, struct inode_t *old, const char *path, bool follow)
+{
+	uint8_t buf[XATTR_MAX];
+
+	uint32_t uid = inode->flags & INODE_UID ? inode->uid : NOOP_ID;
+	uint32_t gid = inode->flags & INODE_GID ? inode->gid : NOOP_ID;
+	uint32_t old_uid = old->flags & INODE_UID ? old->uid : NOOP_ID;
+	uint32_t old_gid = old->flags & INODE_GID ? old->gid : NOOP_ID;
+
+	if (uid == old_uid && gid == old_gid)
+		return;
+
+	size_t len = xattr_encode(buf, uid, gid);
+
+	/*
+	 * Symlinks can't have user.* xattrs, so their ownership can only live
+	 * in the inode table.
+	 */
+	if ((follow ? setxattr : lsetxattr)(path, XATTR_NAME, buf, len, 0) < 0 && errno != EPERM)
+		warn("couldn't store owner of %s in " XATTR_NAME ": %m", path);
+}
+
+/*************************************************************
+ * This section implements the lookups of the inode overlay. *
+ *************************************************************/
+
+bool file_tracking(void)
+{
+	return use_xattr || inode_table_count(&files->inodes) > 0;
+}
+
+struct inode_t *file_lookup(dev_t dev, ino_t ino)
+{
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+	return inode && inode->flags & INODE_FAKED ? inode : NULL;
+}
+
+bool file_needs_path(dev_t dev, ino_t ino)
+{
+	if (!use_xattr)
+		return false;
+
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+	return !inode || !(inode->flags & INODE_XATTR);
+}
+
+struct inode_t *file_load(dev_t dev, ino_t ino, const char *path, bool follow)
+{
+	if (file_needs_path(dev, ino)) {
+		struct inode_t *inode = inode_insert(&files->inodes, dev, ino);
+		if (!inode)
+			return NULL;
+		xattr_load(inode, path, follow);
+	}
+
+	return file_lookup(dev, ino);
+}
+
+void file_chmod(dev_t dev, ino_t ino, mode_t mode)
+{
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+
+	/* Only the permission bits can be changed with chmod(2). */
+	if (inode && inode->flags & INODE_MODE)
+		inode->mode = (inode->mode & S_IFMT) | (mode & 07777);
+}
+
+bool file_fake_mknod(struct cred_t *current, mode_t mode)
+{
+	/* FIFOs and sockets don't need any privileges. */
+	if (!S_ISCHR(mode) && !S_ISBLK(mode))
+		return false;
+	return cred_capable(current, CAP_MKNOD);
+}
+
+void file_mknod(dev_t dev, ino_t ino, mode_t mode, dev_t rdev)
+{
+	struct inode_t *inode = inode_insert(&files->inodes, dev, ino);
+	if (!inode) {
+		warn("couldn't fake device node {%lu, %lu}: %m", (unsigned long) dev, (unsigned long) ino);
+		return;
+	}
+
+	inode->mode = mode;
+	inode->rdev = rdev;
+	inode->flags |= INODE_MODE | INODE_RDEV;
+}
+
+/*
+ * Mirrors generic_permission() in fs/namei.c, but against the faked owner
+ * and mode. The check is done as {uid, gid}, and is privileged if we have
+ * the equivalent of CAP_DAC_OVERRIDE.
+ */
+static int file_permission(struct cred_t *current, struct stat *st, const char *path, bool follow,
+                           uid_t uid, gid_t gid, bool capable, int mask)
+{
+	struct inode_t *inode = file_load(st->st_dev, st->st_ino, path, follow);
+
+	uid_t owner = st->st_uid;
+	gid_t group = st->st_gid;
+	mode_t mode = st->st_mode;
+
+	if (inode) {
+		if (inode->flags & INODE_UID)
+			owner = inode->uid;
+		if (inode->flags & INODE_GID)
+			group = inode->gid;
+		if (inode->flags & INODE_MODE)
+			mode = inode->mode;
+	}
+
+	/* Privileges don't help with writing to read-only filesystems. */
+	if (mask & W_OK && !S_ISCHR(mode) && !S_ISBLK(mode) && !S_ISFIFO(mode) && !S_ISSOCK(mode)) {
+		struct statvfs stv;
+		if (!statvfs(path, &stv) && stv.f_flag & ST_RDONLY)
+			return -EROFS;
+	}
+
+	if (capable) {
+		/* Even root can only execute things that are executable by someone. */
+		if (!(mask & X_OK) || S_ISDIR(mode) || mode & (S_IXUSR | S_IXGRP | S_IXOTH))
+			return 0;
+	}
+
+	if (uid == owner)
+		mode >>= 6;
+	else if (gid == group || cred_has_group(current, group))
+		mode >>= 3;
+
+	if (mask & ~mode & (R_OK | W_OK | X_OK))
+		return -EACCES;
+	return 0;
+}
+
+int __rr_do_access(struct cred_t *current, const char *path, int mode)
+{
+	return __rr_do_faccessat2(current, AT_FDCWD, path, mode, 0);
+}
+
+int __rr_do_faccessat(struct cred_t *current, int dirfd, const char *path, int mode)
+{
+	return __rr_do_faccessat2(current, dirfd, path, mode, 0);
+}
+
+int __rr_do_faccessat2(struct cred_t *current, int dirfd, const char *path, int mode, int flags)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+
+	if (mode & ~(F_OK | R_OK | W_OK | X_OK))
+		return -EINVAL;
+	if (flags & ~(AT_EACCESS | AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))
+		return -EINVAL;
+
+	if (fstatat(dirfd, path, &st, flags & (AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH)) < 0)
+		return -errno;
+	if (mode == F_OK)
+		return 0;
+
+	bool follow = !(flags & AT_SYMLINK_NOFOLLOW) || !path[0];
+	if (dirfd != AT_FDCWD) {
+		if (path[0])
+			snprintf(buf, sizeof(buf), "/proc/self/fd/%d/%s", dirfd, path);
+		else
+			snprintf(buf, sizeof(buf), "/proc/self/fd/%d", dirfd);
+		path = buf;
+	}
+
+	/*
+	 * Unless AT_EACCESS is set, the check is done with the real ids. As in
+	 * access_override_creds(), that also means dropping privileges when
+	 * the real uid isn't root (or raising them when it is).
+	 */
+	if (flags & AT_EACCESS)
+		return file_permission(current, &st, path, follow, current->fsuid, current->fsgid,
+		                       cred_capable(current, CAP_DAC_OVERRIDE), mode);
+
+	bool capable = cred_capable(current, CAP_DAC_OVERRIDE);
+	if (!(current->securebits & issecure_mask(SECURE_NO_SETUID_FIXUP)))
+		capable = current->uid == 0 && current->cap_permitted & (1ULL << CAP_DAC_OVERRIDE);
+	return file_permission(current, &st, path, follow, current->uid, current->gid, capable, mode);
+}
+
+/*****************************************************************
+ * This section implements the faked security.* xattrs. There are *
+ * usually only one or two per inode, so they're packed together. *
+ *****************************************************************/
+
+struct xattr_key_t {
+	uint64_t dev;
+	uint64_t ino;
+};
+
+/*
+ * Each value in the xattrs map is an xattr_list_t followed by len bytes
+ * of entries, each of which is an xattr_entry_t followed by the
+ * NUL-terminated name and then the value.
  */
+struct xattr_list_t {
+	size_t len;
+};
+
+struct xattr_entry_t {
+	uint32_t name_len;
+	uint32_t size;
+};
+
+#define XATTR_ENTRY_LEN(entry) (sizeof(*(entry)) + (entry)->name_len + (entry)->size)
+#define XATTR_ENTRY_NAME(entry) ((char *) ((entry) + 1))
+#define XATTR_ENTRY_VALUE(entry) (XATTR_ENTRY_NAME(entry) + (entry)->name_len)
+
+#define for_each_xattr(entry, list) \
+	for (struct xattr_entry_t *entry = (void *) ((list) + 1); \
+	     (char *) entry < (char *) ((list) + 1) + (list)->len; \
+	     entry = (void *) ((char *) entry + XATTR_ENTRY_LEN(entry)))
+
+static struct xattr_list_t *xattr_list(dev_t dev, ino_t ino)
+{
+	struct xattr_key_t key = { .dev = dev, .ino = ino };
+	return ohm_search(files->xattrs, &key, sizeof(key));
+}
+
+static struct xattr_entry_t *xattr_find(struct xattr_list_t *list, const char *name)
+{
+	if (!list)
+		return NULL;
+
+	for_each_xattr(entry, list)
+		if (!strcmp(XATTR_ENTRY_NAME(entry), name))
+			return entry;
+	return NULL;
+}
+
+/*
+ * Rebuilds the list for {dev, ino} without the entry called name, and
+ * with a new one appended if value is set.
+ */
+static int xattr_update(dev_t dev, ino_t ino, const char *name, const void *value, size_t size)
+{
+	struct xattr_key_t key = { .dev = dev, .ino = ino };
+	struct xattr_list_t *old = xattr_list(dev, ino);
+	size_t name_len = strlen(name) + 1;
+
+	size_t len = old ? old->len : 0;
+	if (value)
+		len += sizeof(struct xattr_entry_t) + name_len + size;
+
+	struct xattr_list_t *new = malloc(sizeof(*new) + len);
+	if (!new)
+		return -ENOMEM;
+
+	char *p = (char *) (new + 1);
+	if (old) {
+		for_each_xattr(entry, old) {
+			if (strcmp(XATTR_ENTRY_NAME(entry), name)) {
+				memcpy(p, entry, XATTR_ENTRY_LEN(entry));
+				p += XATTR_ENTRY_LEN(entry);
+			}
+		}
+	}
+
+	if (value) {
+		struct xattr_entry_t entry = { .name_len = name_len, .size = size };
+		memcpy(p, &entry, sizeof(entry));
+		memcpy(p + sizeof(entry), name, name_len);
+		memcpy(p + sizeof(entry) + name_len, value, size);
+		p += XATTR_ENTRY_LEN(&entry);
+	}
+	new->len = p - (char *) (new + 1);
+
+	int err = 0;
+	if (!new->len) {
+		ohm_remove(files->xattrs, &key, sizeof(key));
+	} else if (!ohm_insert(files->xattrs, &key, sizeof(key), new, sizeof(*new) + new->len)) {
+		err = -ENOMEM;
+	} else {
+		struct inode_t *inode = inode_insert(&files->inodes, dev, ino);
+		if (!inode)
+			err = -ENOMEM;
+		else
+			inode->flags |= INODE_SECURITY;
+	}
+
+	free(new);
+	return err;
+}
+
+#define XATTR_NAME_CAPS "security.capability"
+
+/* The kernel refuses file capabilities it can't parse (see cap_convert_nscap). */
+static bool xattr_valid_caps(const void *value, size_t size)
+{
+	uint32_t magic_etc;
+
+	if (size < sizeof(magic_etc))
+		return false;
+	memcpy(&magic_etc, value, sizeof(magic_etc));
+
+	switch (magic_etc & VFS_CAP_REVISION_MASK) {
+		case VFS_CAP_REVISION_1:
+			return size == XATTR_CAPS_SZ_1;
+		case VFS_CAP_REVISION_2:
+			return size == XATTR_CAPS_SZ_2;
+		case VFS_CAP_REVISION_3:
+			return size == XATTR_CAPS_SZ_3;
+	}
+	return false;
+}
+
+bool file_xattr_faked(dev_t dev, ino_t ino)
+{
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+	return inode && inode->flags & INODE_SECURITY;
+}
+
+int file_setxattr(struct cred_t *current, dev_t dev, ino_t ino, const char *name,
+                  const void *value, size_t size, int flags)
+{
+	size_t name_len = strlen(name);
+
+	if (flags & ~(XATTR_CREATE | XATTR_REPLACE))
+		return -EINVAL;
+	if (!name_len || name_len > XATTR_NAME_MAX)
+		return -ERANGE;
+	if (size > XATTR_SIZE_MAX)
+		return -E2BIG;
+
+	if (!cred_capable(current, strcmp(name, XATTR_NAME_CAPS) ? CAP_SYS_ADMIN : CAP_SETFCAP))
+		return -EPERM;
+
+	if (!strcmp(name, XATTR_NAME_CAPS) && !xattr_valid_caps(value, size))
+		return -EINVAL;
+
+	bool exists = file_xattr_faked(dev, ino) && xattr_find(xattr_list(dev, ino), name);
+	if (flags & XATTR_CREATE && exists)
+		return -EEXIST;
+	if (flags & XATTR_REPLACE && !exists)
+		return -ENODATA;
+
+	/* An empty value still has to be distinguishable from no value. */
+	return xattr_update(dev, ino, name, value ? value : "", size);
+}
+
+ssize_t file_getxattr(dev_t dev, ino_t ino, const char *name, void *value, size_t size)
+{
+	if (!file_xattr_faked(dev, ino))
+		return -ENODATA;
+
+	struct xattr_entry_t *entry = xattr_find(xattr_list(dev, ino), name);
+	if (!entry)
+		return -ENODATA;
+
+	if (size) {
+		if (size < entry->size)
+			return -ERANGE;
+		memcpy(value, XATTR_ENTRY_VALUE(entry), entry->size);
+	}
+	return entry->size;
+}
+
+ssize_t file_listxattr(dev_t dev, ino_t ino, char *list, size_t size)
+{
+	size_t len = 0;
+
+	if (!file_xattr_faked(dev, ino))
+		return 0;
+
+	struct xattr_list_t *xlist = xattr_list(dev, ino);
+	if (!xlist)
+		return 0;
+
+	for_each_xattr(entry, xlist) {
+		if (size) {
+			if (len + entry->name_len > size)
+				return -ERANGE;
+			memcpy(list + len, XATTR_ENTRY_NAME(entry), entry->name_len);
+		}
+		len += entry->name_len;
+	}
+	return len;
+}
+
+int file_removexattr(struct cred_t *current, dev_t dev, ino_t ino, const char *name)
+{
+	/* Like the kernel, check first, so that real xattrs are covered too. */
+	if (!cred_capable(current, strcmp(name, XATTR_NAME_CAPS) ? CAP_SYS_ADMIN : CAP_SETFCAP))
+		return -EPERM;
+	if (!file_xattr_faked(dev, ino) || !xattr_find(xattr_list(dev, ino), name))
+		return -ENODATA;
+
+	return xattr_update(dev, ino, name, NULL, 0);
+}
+
+/*****************************************************************
+ * This section works out what execve(2)ing a file grants. Shells *
+ * exec the same few binaries over and over, so whatever can't be *
+ * answered from the inode table is cached per file.              *
+ *****************************************************************/
+
+/*
+ * The parts of an executable that we have to ask the kernel about. They
+ * are only valid as long as the file's mtime and ctime haven't changed
+ * (a chmod(2) or setxattr(2) only changes the latter).
+ */
+struct exec_entry_t {
+	struct timespec mtime;
+	struct timespec ctime;
+	bool nosuid;
+	size_t caps_size;
+	uint8_t caps[XATTR_CAPS_SZ_3];
+};
+
+static bool timespec_equal(struct timespec a, struct timespec b)
+{
+	return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static struct exec_entry_t *exec_lookup(struct stat *st, const char *path)
+{
+	struct xattr_key_t key = { .dev = st->st_dev, .ino = st->st_ino };
+
+	struct exec_entry_t *exec = ohm_search(files->execs, &key, sizeof(key));
+	if (exec && timespec_equal(exec->mtime, st->st_mtim) && timespec_equal(exec->ctime, st->st_ctim))
+		return exec;
+
+	struct exec_entry_t new = {
+		.mtime = st->st_mtim,
+		.ctime = st->st_ctim,
+	};
+
+	struct statvfs stv;
+	if (!statvfs(path, &stv))
+		new.nosuid = stv.f_flag & ST_NOSUID;
+
+	ssize_t size = getxattr(path, XATTR_NAME_CAPS, new.caps, sizeof(new.caps));
+	if (size > 0 && xattr_valid_caps(new.caps, size))
+		new.caps_size = size;
+
+	return ohm_insert(files->execs, &key, sizeof(key), &new, sizeof(new));
+}
+
+/* Mirrors get_vfs_caps_from_disk() and bprm_caps_from_vfs_caps(). */
+static void exec_caps(struct cred_bprm_t *bprm, const uint8_t *value, size_t size)
+{
+	struct vfs_ns_cap_data caps = {0};
+	memcpy(&caps, value, size);
+
+	/* We're pretending to be in the initial namespace, so only root owns caps. */
+	if ((caps.magic_etc & VFS_CAP_REVISION_MASK) == VFS_CAP_REVISION_3 && caps.rootid)
+		return;
+
+	bprm->fcaps = true;
+	bprm->fcaps_effective = caps.magic_etc & VFS_CAP_FLAGS_EFFECTIVE;
+	bprm->fcaps_permitted = caps.data[0].permitted;
+	bprm->fcaps_inheritable = caps.data[0].inheritable;
+	if ((caps.magic_etc & VFS_CAP_REVISION_MASK) != VFS_CAP_REVISION_1) {
+		bprm->fcaps_permitted |= (uint64_t) caps.data[1].permitted << 32;
+		bprm->fcaps_inheritable |= (uint64_t) caps.data[1].inheritable << 32;
+	}
+}
+
+int file_exec(const char *path, struct cred_bprm_t *bprm)
+{
+	struct stat st;
+
+	*bprm = (struct cred_bprm_t) {0};
+	if (stat(path, &st) < 0)
+		return -errno;
+
+	struct exec_entry_t *exec = exec_lookup(&st, path);
+	if (!exec)
+		return -ENOMEM;
+
+	/* nosuid mounts ignore set-id bits and file capabilities alike. */
+	if (exec->nosuid)
+		return 0;
+
+	struct inode_t *inode = file_load(st.st_dev, st.st_ino, path, true);
+	uid_t uid = st.st_uid;
+	gid_t gid = st.st_gid;
+	mode_t mode = st.st_mode;
+
+	if (inode) {
+		if (inode->flags & INODE_UID)
+			uid = inode->uid;
+		if (inode->flags & INODE_GID)
+			gid = inode->gid;
+		if (inode->flags & INODE_MODE)
+			mode = inode->mode;
+	}
+
+	if (mode & S_ISUID) {
+		bprm->setuid = true;
+		bprm->uid = uid;
+	}
+	/* Without group-execute, S_ISGID means mandatory locking. */
+	if ((mode & (S_ISGID | S_IXGRP)) == (S_ISGID | S_IXGRP)) {
+		bprm->setgid = true;
+		bprm->gid = gid;
+	}
+
+	uint8_t caps[XATTR_CAPS_SZ_3];
+	ssize_t size = file_getxattr(st.st_dev, st.st_ino, XATTR_NAME_CAPS, caps, sizeof(caps));
+	if (size == -ENODATA) {
+		size = exec->caps_size;
+		memcpy(caps, exec->caps, size);
+	}
+	if (size > 0)
+		exec_caps(bprm, caps, size);
+	return 0;
+}
+
+bool file_known(dev_t dev, ino_t ino)
+{
+	return inode_search(&files->inodes, dev, ino) != NULL;
+}
+
+void file_xattr_changed(dev_t dev, ino_t ino, const char *name)
+{
+	if (!use_xattr || strcmp(name, XATTR_NAME))
+		return;
+
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+	if (inode && inode->flags & INODE_XATTR)
+		xattr_uncache(inode);
+}
+
+void file_forget(dev_t dev, ino_t ino)
+{
+	struct inode_t *inode = inode_search(&files->inodes, dev, ino);
+
+	if (inode && inode->flags & INODE_SECURITY) {
+		struct xattr_key_t key = { .dev = dev, .ino = ino };
+		ohm_remove(files->xattrs, &key, sizeof(key));
+	}
+	inode_remove(&files->inodes, dev, ino);
+}
+
+/* Mirrors chown_common() in fs/open.c, but against the faked owners. */
+static int file_chown(struct cred_t *current, struct stat *st, const char *path, bool follow,
+                      uid_t owner, gid_t group)
+{
+	struct inode_t *inode = file_load(st->st_dev, st->st_ino, path, follow);
+
+	uid_t uid = st->st_uid;
+	gid_t gid = st->st_gid;
+	mode_t mode = st->st_mode;
+
+	if (inode) {
+		if (inode->flags & INODE_UID)
+			uid = inode->uid;
+		if (inode->flags & INODE_GID)
+			gid = inode->gid;
+		if (inode->flags & INODE_MODE)
+			mode = inode->mode;
+	}
+
+	if (!cred_capable(current, CAP_CHOWN)) {
+		/* You can only "change" the owner to yourself. */
+		if (owner != (uid_t) -1 && (current->fsuid != uid || owner != uid))
+			goto error;
+		/* You can only change the group to one you're in. */
+		if (group != (gid_t) -1 && (current->fsuid != uid ||
+		                            (group != gid && !cred_in_group(current, group))))
+			goto error;
+	}
+
+	inode = inode_insert(&files->inodes, st->st_dev, st->st_ino);
+	if (!inode)
+		return -ENOMEM;
+
+	struct inode_t old = *inode;
+	if (owner != (uid_t) -1) {
+		inode->uid = owner;
+		inode->flags |= INODE_UID;
+	}
+	if (group != (gid_t) -1) {
+		inode->gid = group;
+		inode->flags |= INODE_GID;
+	}
+
+	/* Changing the owner of a non-directory always kills the set[ug]id bits. */
+	if (!S_ISDIR(mode)) {
+		mode_t killed = mode & ~S_ISUID;
+		if (killed & S_IXGRP)
+			killed &= ~S_ISGID;
+
+		if (killed != mode) {
+			inode->mode = killed;
+			inode->flags |= INODE_MODE;
+		}
+	}
+
+	if (use_xattr)
+		xattr_store(inode, &old, path, follow);
+	return 0;
+
+error:
+	return -EPERM;
+}
+
+int __rr_do_chown(struct cred_t *current, const char *path, uid_t owner, gid_t group)
+{
+	return __rr_do_fchownat(current, AT_FDCWD, path, owner, group, 0);
+}
+
+int __rr_do_fchown(struct cred_t *current, int fd, uid_t owner, gid_t group)
+{
+	return __rr_do_fchownat(current, fd, "", owner, group, AT_EMPTY_PATH);
+}
+
+int __rr_do_lchown(struct cred_t *current, const char *path, uid_t owner, gid_t group)
+{
+	return __rr_do_fchownat(current, AT_FDCWD, path, owner, group, AT_SYMLINK_NOFOLLOW);
+}
+
+int __rr_do_fchownat(struct cred_t *current, int dirfd, const char *path, uid_t owner, gid_t group, int flags)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+
+	if (flags & ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))
+		return -EINVAL;
+
+	if (fstatat(dirfd, path, &st, flags) < 0)
+		return -errno;
+
+	/*
+	 * The xattr syscalls don't have *at variants. An empty path refers to
+	 * dirfd itself, which means following the /proc/self/fd magic link.
+	 */
+	bool follow = !(flags & AT_SYMLINK_NOFOLLOW) || !path[0];
+	if (dirfd != AT_FDCWD) {
+		if (path[0])
+			snprintf(buf, sizeof(buf), "/proc/self/fd/%d/%s", dirfd, path);
+		else
+			snprintf(buf, sizeof(buf), "/proc/self/fd/%d", dirfd);
+		path = buf;
+	}
 
-/* TODO */
+	return file_chown(current, &st, path, follow, owner, group);
+}
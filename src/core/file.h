@@ -0,0 +1,140 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(REMAINROOT_FILE_H) || defined(SYSCALL0) || defined(LIBCALL0)
+#include <sys/types.h>
+#include <stdbool.h>
+
+#if !defined(REMAINROOT_FILE_H)
+#define REMAINROOT_FILE_H
+
+#include "core/inode.h"
+
+/*
+ * We can't include cred.h here, since it would re-expand its SYSCALL
+ * definitions if we're being included with SYSCALL defined.
+ */
+struct cred_t;
+struct cred_bprm_t;
+
+/*
+ * Keeps the faked inode metadata in a state file, loading whatever was
+ * there from previous runs. Must be called before any tracing starts.
+ */
+void file_open_state(const char *path);
+
+/*
+ * Faked metadata is kept separately for each domain, so that unrelated
+ * containers traced by the same process don't see each other's. NULL is
+ * the domain that everything starts out in, which is the one the state
+ * file belongs to. file_domain_new returns an empty domain with a single
+ * reference, which file_domain_put frees once the last one is gone.
+ * file_domain_use picks the domain that every other function here uses.
+ */
+struct file_domain_t;
+struct file_domain_t *file_domain_new(void);
+void file_domain_get(struct file_domain_t *domain);
+void file_domain_put(struct file_domain_t *domain);
+void file_domain_use(struct file_domain_t *domain);
+
+/*
+ * Stores faked ownership in the user.rootlesscontainers xattr of each file
+ * (as well as in the inode table, which then acts as a cache).
+ */
+void file_use_xattr(void);
+
+/* Whether there is any faked inode metadata at all. */
+bool file_tracking(void);
+
+/* Gets the faked metadata for an inode, or NULL if it isn't faked. */
+struct inode_t *file_lookup(dev_t dev, ino_t ino);
+
+/*
+ * Whether the faked metadata for an inode might be stored on the file
+ * itself, and hasn't been loaded yet. If so, file_load has to be given a
+ * path to the inode (following symlinks if follow is set) to load it.
+ */
+bool file_needs_path(dev_t dev, ino_t ino);
+struct inode_t *file_load(dev_t dev, ino_t ino, const char *path, bool follow);
+
+/* Updates faked metadata after the inode was successfully chmod(2)ed. */
+void file_chmod(dev_t dev, ino_t ino, mode_t mode);
+
+/*
+ * Whether a mknod(2) of mode would fail for real but should succeed for
+ * current. If so, a regular file is created in its place and file_mknod is
+ * used to make it look like the node that was asked for.
+ */
+bool file_fake_mknod(struct cred_t *current, mode_t mode);
+void file_mknod(dev_t dev, ino_t ino, mode_t mode, dev_t rdev);
+
+/*
+ * Faked security.* xattrs, which need privileges that we don't have to
+ * set. Like the syscalls, these return -errno on failure. The getters
+ * return -ENODATA if the xattr isn't faked (so the real one should be
+ * used), and file_listxattr only lists the faked names. file_removexattr
+ * checks permissions first, so -ENODATA means the caller may remove the
+ * real one.
+ */
+#define FILE_XATTR_PREFIX "security."
+bool file_xattr_faked(dev_t dev, ino_t ino);
+int file_setxattr(struct cred_t *current, dev_t dev, ino_t ino, const char *name,
+                  const void *value, size_t size, int flags);
+ssize_t file_getxattr(dev_t dev, ino_t ino, const char *name, void *value, size_t size);
+ssize_t file_listxattr(dev_t dev, ino_t ino, char *list, size_t size);
+int file_removexattr(struct cred_t *current, dev_t dev, ino_t ino, const char *name);
+
+/*
+ * Fills bprm with what executing the file at path (which is followed)
+ * grants, going by its faked owner, mode and file capabilities. Returns
+ * -errno on failure, in which case bprm grants nothing.
+ */
+int file_exec(const char *path, struct cred_bprm_t *bprm);
+
+/* Whether there is any state at all for an inode. */
+bool file_known(dev_t dev, ino_t ino);
+
+/*
+ * Tells us that a tracee successfully set or removed the xattr name of an
+ * inode. If that's where ownership is stored, it has to be read again.
+ */
+void file_xattr_changed(dev_t dev, ino_t ino, const char *name);
+
+/* Drops any faked metadata for an inode that has been removed. */
+void file_forget(dev_t dev, ino_t ino);
+
+#endif /* !defined(REMAINROOT_FILE_H) */
+
+/* SYSCALL and LIBCALL definitions. */
+#include "syscalls-def.h"
+
+/* Shims for file ownership. */
+SYSCALL3(int, chown, const char *, path, uid_t, owner, gid_t, group)
+SYSCALL3(int, fchown, int, fd, uid_t, owner, gid_t, group)
+SYSCALL3(int, lchown, const char *, path, uid_t, owner, gid_t, group)
+SYSCALL5(int, fchownat, int, dirfd, const char *, path, uid_t, owner, gid_t, group, int, flags)
+
+/* Shims for permission checks. */
+SYSCALL2(int, access, const char *, path, int, mode)
+SYSCALL3(int, faccessat, int, dirfd, const char *, path, int, mode)
+SYSCALL4(int, faccessat2, int, dirfd, const char *, path, int, mode, int, flags)
+
+/* Clean up. */
+#include "syscalls-undef.h"
+
+#endif /* !defined(REMAINROOT_FILE_H) || defined(SYSCALL) || defined(LIBCALL) */
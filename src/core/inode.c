@@ -0,0 +1,397 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * inode.c is the table of faked inode metadata. We can't use ohmic for
+ * this, because it does a few allocations per entry and we need to
+ * store millions of entries (one for every file in a rootfs). Instead
+ * this is a flat array using linear probing, which keeps each entry to
+ * a few words and lookups to (usually) a single cache line.
+ *
+ * The table can also live in a state file, so that faked metadata
+ * survives between runs. Since everything (including the filter) is in a
+ * single fixed-layout mapping, opening a state file is O(1) no matter how
+ * many entries it has. Resizing builds a new file and renames it over the
+ * old one, so there is never a point where a crash loses the table.
+ *
+ * XXX: st_dev isn't necessarily stable across mounts (overlayfs gets a new
+ *      anonymous device every time), in which case a state file won't
+ *      match anything after a remount.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "core/inode.h"
+
+#define INODE_MIN_SIZE 1024
+
+/* Mixes {dev, ino} so that sequential inode numbers spread out. */
+static inline size_t inode_hash(dev_t dev, ino_t ino)
+{
+	uint64_t h = (uint64_t) ino * 0x9e3779b97f4a7c15ULL;
+	h ^= (uint64_t) dev * 0xc2b2ae3d27d4eb4fULL;
+	h ^= h >> 31;
+	return h;
+}
+
+/* Returns the filter bits for a hash, which are all in the same word. */
+static inline uint64_t inode_filter_bits(size_t h)
+{
+	h *= 0xff51afd7ed558ccdULL;
+	return (1ULL << ((h >> 52) & 63)) | (1ULL << ((h >> 58) & 63));
+}
+
+static inline uint64_t *inode_filter_word(struct inode_table_t *table, size_t h)
+{
+	return &table->filter[(h >> 20) & ((table->size >> 3) - 1)];
+}
+
+static inline void inode_filter_add(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	size_t h = inode_hash(dev, ino);
+	*inode_filter_word(table, h) |= inode_filter_bits(h);
+}
+
+/* Whether {dev, ino} might be in the table. */
+static inline bool inode_filter_test(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	size_t h = inode_hash(dev, ino);
+	uint64_t bits = inode_filter_bits(h);
+	return (*inode_filter_word(table, h) & bits) == bits;
+}
+
+/* Find the slot for {dev, ino}, which is either its entry or empty. */
+static struct inode_t *inode_slot(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	size_t mask = table->size - 1;
+	size_t i = inode_hash(dev, ino) & mask;
+
+	for (;;) {
+		struct inode_t *entry = &table->entries[i];
+		if (!entry->flags)
+			return entry;
+		if (entry->ino == ino && entry->dev == dev)
+			return entry;
+		i = (i + 1) & mask;
+	}
+}
+
+/*
+ * The whole table is one mapping. There are 8 slots per filter word, so
+ * about 10 bits of filter per entry at most.
+ */
+static size_t inode_map_len(size_t size)
+{
+	return sizeof(struct inode_header_t) + size * sizeof(struct inode_t) +
+	       (size >> 3) * sizeof(uint64_t);
+}
+
+static int inode_map(struct inode_table_t *table, int fd, size_t size)
+{
+	void *map;
+	size_t len = inode_map_len(size);
+
+	if (fd < 0)
+		map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	else
+		map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	table->header = map;
+	table->entries = (struct inode_t *) (table->header + 1);
+	table->filter = (uint64_t *) (table->entries + size);
+	table->size = size;
+	table->fd = fd;
+	return 0;
+}
+
+static void inode_unmap(struct inode_table_t *table)
+{
+	if (table->header)
+		munmap(table->header, inode_map_len(table->size));
+	if (table->fd >= 0)
+		close(table->fd);
+	table->header = NULL;
+	table->fd = -1;
+}
+
+/* Lays out an empty table of the given size in fd (or memory, if fd < 0). */
+static int inode_format(struct inode_table_t *table, int fd, size_t size)
+{
+	if (fd >= 0 && ftruncate(fd, inode_map_len(size)) < 0)
+		return -1;
+	if (inode_map(table, fd, size) < 0)
+		return -1;
+
+	memcpy(table->header->magic, INODE_MAGIC, sizeof(table->header->magic));
+	table->header->version = INODE_VERSION;
+	table->header->entry_size = sizeof(struct inode_t);
+	table->header->size = size;
+	table->header->dirty = 1;
+	return 0;
+}
+
+/*
+ * Creates a new empty table of the given size. If path is set, the table
+ * is backed by a new (locked) temporary file next to path, whose name is
+ * put in tmp so it can be renamed over path once it's filled.
+ */
+static int inode_create(struct inode_table_t *table, const char *path, char **tmp, size_t size)
+{
+	int fd = -1;
+
+	*table = (struct inode_table_t) { .fd = -1 };
+
+	if (path) {
+		if (asprintf(tmp, "%s.XXXXXX", path) < 0)
+			return -1;
+
+		fd = mkostemp(*tmp, O_CLOEXEC);
+		if (fd < 0)
+			goto error_free;
+		if (flock(fd, LOCK_EX) < 0)
+			goto error_unlink;
+	}
+
+	if (inode_format(table, fd, size) < 0)
+		goto error_unlink;
+	return 0;
+
+error_unlink:
+	if (fd >= 0) {
+		unlink(*tmp);
+		close(fd);
+	}
+error_free:
+	if (path)
+		free(*tmp);
+	return -1;
+}
+
+static int inode_resize(struct inode_table_t *table, size_t size)
+{
+	struct inode_table_t new;
+	char *tmp = NULL;
+
+	if (inode_create(&new, table->path, &tmp, size) < 0)
+		return -1;
+
+	for (size_t i = 0; i < table->size; i++) {
+		struct inode_t *old = &table->entries[i];
+		if (old->flags) {
+			*inode_slot(&new, old->dev, old->ino) = *old;
+			inode_filter_add(&new, old->dev, old->ino);
+			new.header->count++;
+		}
+	}
+
+	/* Atomically replace the state file, so a crash can't lose anything. */
+	if (table->path) {
+		if (rename(tmp, table->path) < 0) {
+			unlink(tmp);
+			free(tmp);
+			inode_unmap(&new);
+			return -1;
+		}
+		free(tmp);
+	}
+
+	new.path = table->path;
+	inode_unmap(table);
+	*table = new;
+	return 0;
+}
+
+/* Round up to a power of two, keeping the load factor below 3/4. */
+static size_t inode_fit(size_t count)
+{
+	size_t size = INODE_MIN_SIZE;
+
+	while (size / 4 * 3 < count)
+		size <<= 1;
+	return size;
+}
+
+int inode_table_init(struct inode_table_t *table, size_t hint)
+{
+	return inode_create(table, NULL, NULL, inode_fit(hint));
+}
+
+/* Recount the entries and rebuild the filter, after an unclean shutdown. */
+static void inode_recover(struct inode_table_t *table)
+{
+	table->header->count = 0;
+	table->header->removed = 0;
+	memset(table->filter, 0, (table->size >> 3) * sizeof(uint64_t));
+
+	for (size_t i = 0; i < table->size; i++) {
+		struct inode_t *entry = &table->entries[i];
+		if (entry->flags) {
+			inode_filter_add(table, entry->dev, entry->ino);
+			table->header->count++;
+		}
+	}
+}
+
+int inode_table_open(struct inode_table_t *table, const char *path, size_t hint)
+{
+	struct inode_header_t header;
+	struct stat st;
+
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	/* Two tracers sharing a state file would corrupt it. */
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+		goto error;
+	if (fstat(fd, &st) < 0)
+		goto error;
+
+	/*
+	 * A new state file, just start from scratch. This has to happen on the
+	 * fd we locked, otherwise another tracer could open (and fill) the file
+	 * in between.
+	 */
+	if (!st.st_size) {
+		*table = (struct inode_table_t) { .fd = -1 };
+		if (inode_format(table, fd, inode_fit(hint)) < 0)
+			goto error;
+		table->path = strdup(path);
+		return 0;
+	}
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+		goto error_invalid;
+	if (memcmp(header.magic, INODE_MAGIC, sizeof(header.magic)) ||
+	    header.version != INODE_VERSION ||
+	    header.entry_size != sizeof(struct inode_t) ||
+	    !header.size || header.size & (header.size - 1) ||
+	    (size_t) st.st_size != inode_map_len(header.size))
+		goto error_invalid;
+
+	if (inode_map(table, fd, header.size) < 0)
+		goto error;
+	if (table->header->dirty)
+		inode_recover(table);
+
+	table->header->dirty = 1;
+	table->path = strdup(path);
+	return 0;
+
+error_invalid:
+	errno = EINVAL;
+error:
+	close(fd);
+	return -1;
+}
+
+int inode_table_compact(struct inode_table_t *table)
+{
+	size_t size = inode_fit(table->header->count);
+
+	if (size == table->size && !table->header->removed)
+		return 0;
+	return inode_resize(table, size);
+}
+
+void inode_table_free(struct inode_table_t *table)
+{
+	if (table->header && table->fd >= 0) {
+		table->header->dirty = 0;
+		msync(table->header, inode_map_len(table->size), MS_SYNC);
+	}
+
+	inode_unmap(table);
+	free(table->path);
+	*table = (struct inode_table_t) { .fd = -1 };
+}
+
+struct inode_t *inode_search(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	if (!table->header->count || !inode_filter_test(table, dev, ino))
+		return NULL;
+
+	struct inode_t *entry = inode_slot(table, dev, ino);
+	return entry->flags ? entry : NULL;
+}
+
+struct inode_t *inode_insert(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	struct inode_t *entry = inode_slot(table, dev, ino);
+	if (entry->flags)
+		return entry;
+
+	if (table->header->count + 1 > table->size / 4 * 3) {
+		if (inode_resize(table, table->size << 1) < 0)
+			return NULL;
+		entry = inode_slot(table, dev, ino);
+	}
+
+	*entry = (struct inode_t) {
+		.dev = dev,
+		.ino = ino,
+		.flags = INODE_USED,
+	};
+	inode_filter_add(table, dev, ino);
+	table->header->count++;
+	return entry;
+}
+
+void inode_remove(struct inode_table_t *table, dev_t dev, ino_t ino)
+{
+	if (!table->header->count)
+		return;
+
+	size_t mask = table->size - 1;
+	struct inode_t *entry = inode_slot(table, dev, ino);
+	if (!entry->flags)
+		return;
+
+	/*
+	 * Rather than leaving tombstones, shift back any later entries in the
+	 * same probe sequence that would no longer be reachable.
+	 */
+	size_t hole = entry - table->entries;
+	for (size_t i = (hole + 1) & mask; table->entries[i].flags; i = (i + 1) & mask) {
+		size_t home = inode_hash(table->entries[i].dev, table->entries[i].ino) & mask;
+
+		/* Is home cyclically in (hole, i]? If so, the entry can stay. */
+		if (((i - home) & mask) < ((i - hole) & mask))
+			continue;
+
+		table->entries[hole] = table->entries[i];
+		hole = i;
+	}
+
+	memset(&table->entries[hole], 0, sizeof(struct inode_t));
+	table->header->count--;
+	table->header->removed++;
+}
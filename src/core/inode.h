@@ -0,0 +1,131 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(CORE_INODE_H)
+#define CORE_INODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Which fields of an inode_t are being faked. */
+#define INODE_USED (1 << 0)
+#define INODE_UID  (1 << 1)
+#define INODE_GID  (1 << 2)
+#define INODE_MODE (1 << 3)
+/* The owner stored on the file itself has been loaded. */
+#define INODE_XATTR (1 << 4)
+#define INODE_RDEV (1 << 5)
+/* There are faked security.* xattrs (which live in file.c). */
+#define INODE_SECURITY (1 << 6)
+
+/* All of the flags for fields that are being faked. */
+#define INODE_FAKED (INODE_UID | INODE_GID | INODE_MODE | INODE_RDEV)
+
+/*
+ * inode_t is the faked metadata for a single inode. It is kept as small
+ * as possible, because a rootfs can easily have millions of these. It is
+ * also stored as-is in state files, so it must have a fixed layout.
+ */
+struct inode_t {
+	uint64_t dev;
+	uint64_t ino;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t mode;
+	uint32_t flags;
+	/* Only meaningful for faked device nodes. */
+	uint64_t rdev;
+};
+
+/*
+ * The table is a single mapping (either anonymous or of a state file),
+ * laid out as this header, then the entries, then the filter. This means
+ * that loading a state file is just a matter of mapping it.
+ */
+#define INODE_MAGIC   "RRINODE"
+#define INODE_VERSION 2
+
+struct inode_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint64_t size;
+	uint64_t count;
+	/* Entries removed since the filter was last rebuilt. */
+	uint64_t removed;
+	/* Set while the table is open, so we can tell if we crashed. */
+	uint32_t dirty;
+	uint32_t __pad[5];
+};
+
+/*
+ * An open-addressed (linear probing) table of inode_t, keyed by
+ * {dev, ino}. The size is always a power of two.
+ *
+ * Most lookups are for inodes that aren't in the table, so there is also a
+ * (blocked) bloom filter with one word per 8 slots. This is far smaller than
+ * the table, so it stays in cache even when the table doesn't. Removals
+ * don't clear the filter, it's only rebuilt when the table is resized.
+ */
+struct inode_table_t {
+	struct inode_header_t *header;
+	struct inode_t *entries;
+	uint64_t *filter;
+	size_t size;
+
+	/* Only set for tables backed by a state file. */
+	int fd;
+	char *path;
+};
+
+/* Sets up a new (in-memory) table that can hold at least hint entries. */
+int inode_table_init(struct inode_table_t *table, size_t hint);
+
+/*
+ * Opens (or creates) a table backed by the state file at path. The file is
+ * locked for as long as it's open, and changes are written straight to the
+ * mapping, so they survive us crashing.
+ */
+int inode_table_open(struct inode_table_t *table, const char *path, size_t hint);
+
+/* Shrinks the table to fit its entries, and rebuilds the filter. */
+int inode_table_compact(struct inode_table_t *table);
+
+void inode_table_free(struct inode_table_t *table);
+
+/* How many entries are in the table. */
+static inline size_t inode_table_count(struct inode_table_t *table)
+{
+	return table->header ? table->header->count : 0;
+}
+
+/* Finds the entry for {dev, ino}, or NULL if it isn't in the table. */
+struct inode_t *inode_search(struct inode_table_t *table, dev_t dev, ino_t ino);
+
+/*
+ * Finds the entry for {dev, ino}, creating an empty one (with only
+ * INODE_USED set) if it doesn't exist. Returns NULL if the table couldn't
+ * grow. Any previously returned pointers are invalidated.
+ */
+struct inode_t *inode_insert(struct inode_table_t *table, dev_t dev, ino_t ino);
+
+/* Removes the entry for {dev, ino}, if it exists. */
+void inode_remove(struct inode_table_t *table, dev_t dev, ino_t ino);
+
+#endif /* !defined(CORE_INODE_H) */
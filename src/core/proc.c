@@ -18,17 +18,37 @@
 
 /* core/ is the current state. */
 
+#include <stddef.h>
+
 #include "core/proc.h"
 #include "core/cred.h"
 
 void proc_new(struct proc_t *proc)
 {
+	proc->flags = 0;
+	proc->ppid = 0;
+	proc->children = 0;
+	proc->tgid = 0;
 	cred_new(&proc->cred);
+	proc->rlimit = (struct rlimit_t) {0};
+	proc->syscall = (struct syscall_t) {0};
+	proc->files = NULL;
+	proc->exe = 0;
+	proc->starttime = 0;
 }
 
 /* Clones a proc_t, so it can be used for another process */
 void proc_clone(struct proc_t *new, struct proc_t *old)
 {
 	new->pid = old->pid;
+	new->flags = 0;
+	new->ppid = old->pid;
+	new->children = 0;
+	new->tgid = old->tgid;
 	cred_clone(&new->cred, &old->cred);
+	new->rlimit = old->rlimit;
+	new->files = old->files;
+	new->exe = old->exe;
+	new->syscall = (struct syscall_t) {0};
+	new->starttime = 0;
 }
@@ -19,13 +19,73 @@
 #if !defined(CORE_PROC_H)
 #define CORE_PROC_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include "core/cred.h"
+#include "core/rlimit.h"
+
+/*
+ * syscall_t is the state of the syscall a process is currently inside of.
+ * This is only used by shims that see syscall entry and exit separately,
+ * and isn't copied by proc_clone.
+ */
+struct syscall_t {
+	bool active;
+	long number;
+
+	/* Whether to replace the return value with ret on exit. */
+	bool replace;
+	uintptr_t ret;
+
+	/* Shims can stash things here to use on syscall exit. */
+	uintptr_t scratch[4];
+
+	/* Time spent in the tracer so far, for --stats. */
+	uint64_t ns;
+};
+
+/* Flags used by shims to track the lifecycle of a process. */
+#define PROC_STARTING (1 << 0) /* Hasn't had its first stop yet. */
+#define PROC_ORPHAN   (1 << 1) /* Stopped before we knew who its parent was. */
+#define PROC_DETACHING (1 << 2) /* To be detached at its next SIGSTOP. */
+
+struct file_domain_t;
 
 /* proc_t is the wrapper for all core/ state. */
 struct proc_t {
 	pid_t pid;
+	unsigned int flags;
+
+	/*
+	 * The (traced) thread or process that created this one, or 0 for the
+	 * root of a tree, and how many it has created that are still around.
+	 * If a parent goes away first, its children go to its own parent.
+	 */
+	pid_t ppid;
+	unsigned int children;
+
+	/* The thread group leader, which holds the per-process state. */
+	pid_t tgid;
+
 	struct cred_t cred;
+	struct rlimit_t rlimit;
+	struct syscall_t syscall;
+
+	/*
+	 * The faked file metadata (see core/file.h) of the tree this is in, or
+	 * NULL for the shared one. Tracers hold a reference for each proc_t.
+	 */
+	struct file_domain_t *files;
+
+	/* Which executable this is running, for --stats (see ptrace/stats.c). */
+	unsigned int exe;
+
+	/*
+	 * When a detached process started, in clock ticks since boot, so that
+	 * it can be told apart from a later process with the same pid.
+	 */
+	unsigned long long starttime;
 };
 
 /* Initiates a new proc_t with the current process context. */
@@ -0,0 +1,259 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * procfs.c generates the contents of the files in /proc that would give
+ * away the real credentials of a process (see the comment at the top of
+ * cred.c). The shims swap opens of the real files for one of these.
+ *
+ * /proc/<pid>/status has a lot in it that we don't fake, so it's rendered
+ * from the real file with only the credential lines replaced. Those lines
+ * are cached by cred_t version, since tools like ps(1) read the status of
+ * many processes that usually share the same credentials.
+ *
+ * XXX: The maps are rendered as though we're in the initial user
+ *      namespace, since that's what a real root would see.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "core/cred.h"
+#include "core/procfs.h"
+
+/* Parses a pid at the start of *path, moving past it. */
+static pid_t parse_pid(const char **path)
+{
+	char *end;
+
+	if (**path < '1' || **path > '9')
+		return -1;
+
+	long pid = strtol(*path, &end, 10);
+	if (pid <= 0 || pid > INT32_MAX)
+		return -1;
+
+	*path = end;
+	return pid;
+}
+
+/* Strips prefix from *path, if it is one. */
+static bool skip(const char **path, const char *prefix)
+{
+	size_t len = strlen(prefix);
+
+	if (strncmp(*path, prefix, len))
+		return false;
+	*path += len;
+	return true;
+}
+
+enum procfs_file procfs_parse(const char *path, pid_t self, pid_t *pid)
+{
+	if (!skip(&path, "/proc/"))
+		return PROCFS_NONE;
+
+	if (skip(&path, "self/") || skip(&path, "thread-self/"))
+		*pid = self;
+	else if ((*pid = parse_pid(&path)) < 0 || !skip(&path, "/"))
+		return PROCFS_NONE;
+
+	/* Threads have their own credentials, so /proc/<pid>/task/<tid>. */
+	if (skip(&path, "task/")) {
+		if ((*pid = parse_pid(&path)) < 0 || !skip(&path, "/"))
+			return PROCFS_NONE;
+	}
+
+	if (!strcmp(path, "status"))
+		return PROCFS_STATUS;
+	if (!strcmp(path, "uid_map"))
+		return PROCFS_UID_MAP;
+	if (!strcmp(path, "gid_map"))
+		return PROCFS_GID_MAP;
+	return PROCFS_NONE;
+}
+
+/* The credential lines of status, as rendered by proc_pid_status(). */
+static const char *status_names[] = {
+	"Uid:",
+	"Gid:",
+	"Groups:",
+	"CapInh:",
+	"CapPrm:",
+	"CapEff:",
+	"CapBnd:",
+	"CapAmb:",
+};
+
+#define STATUS_LINES (sizeof(status_names) / sizeof(*status_names))
+
+struct status_lines_t {
+	unsigned long version;
+	char *buf;
+
+	/* Offsets of each line in buf, and the end of the last one. */
+	size_t offsets[STATUS_LINES + 1];
+};
+
+/* A small direct-mapped cache, indexed by cred_t version. */
+#define STATUS_CACHE_SIZE 16
+static struct status_lines_t status_cache[STATUS_CACHE_SIZE];
+
+static struct status_lines_t *status_lines(struct cred_t *cred)
+{
+	struct status_lines_t *lines = &status_cache[cred->version % STATUS_CACHE_SIZE];
+	size_t offsets[STATUS_LINES + 1];
+	char *buf;
+	size_t len;
+	int i = 0;
+
+	if (lines->buf && lines->version == cred->version)
+		return lines;
+
+	FILE *f = open_memstream(&buf, &len);
+	if (!f)
+		return NULL;
+
+	offsets[i++] = ftell(f);
+	fprintf(f, "Uid:\t%u\t%u\t%u\t%u\n", cred->uid, cred->euid, cred->suid, cred->fsuid);
+	offsets[i++] = ftell(f);
+	fprintf(f, "Gid:\t%u\t%u\t%u\t%u\n", cred->gid, cred->egid, cred->sgid, cred->fsgid);
+	offsets[i++] = ftell(f);
+	fprintf(f, "Groups:\t");
+	for (int j = 0; j < cred->ngroups; j++)
+		fprintf(f, "%u ", cred->groups[j]);
+	fprintf(f, "\n");
+	offsets[i++] = ftell(f);
+	fprintf(f, "CapInh:\t%016llx\n", (unsigned long long) cred->cap_inheritable);
+	offsets[i++] = ftell(f);
+	fprintf(f, "CapPrm:\t%016llx\n", (unsigned long long) cred->cap_permitted);
+	offsets[i++] = ftell(f);
+	fprintf(f, "CapEff:\t%016llx\n", (unsigned long long) cred->cap_effective);
+	offsets[i++] = ftell(f);
+	fprintf(f, "CapBnd:\t%016llx\n", (unsigned long long) cred->cap_bset);
+	offsets[i++] = ftell(f);
+	fprintf(f, "CapAmb:\t%016llx\n", (unsigned long long) cred->cap_ambient);
+
+	if (fclose(f) == EOF)
+		return NULL;
+	offsets[i] = len;
+
+	free(lines->buf);
+	lines->version = cred->version;
+	lines->buf = buf;
+	memcpy(lines->offsets, offsets, sizeof(offsets));
+	return lines;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int render_status(int fd, pid_t pid, struct cred_t *cred)
+{
+	char path[64], *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int err = 0;
+
+	struct status_lines_t *lines = status_lines(cred);
+	if (!lines)
+		return -ENOMEM;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	FILE *f = fopen(path, "re");
+	if (!f)
+		return -errno;
+
+	while ((len = getline(&line, &size, f)) >= 0) {
+		const char *out = line;
+		size_t out_len = len;
+
+		for (size_t i = 0; i < STATUS_LINES; i++) {
+			if (!strncmp(line, status_names[i], strlen(status_names[i]))) {
+				out = lines->buf + lines->offsets[i];
+				out_len = lines->offsets[i + 1] - lines->offsets[i];
+				break;
+			}
+		}
+
+		if (write_all(fd, out, out_len) < 0) {
+			err = -errno;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+	return err;
+}
+
+static int render_id_map(int fd)
+{
+	char buf[64];
+
+	int len = snprintf(buf, sizeof(buf), "%10u %10u %10u\n", 0, 0, UINT32_MAX);
+	return write_all(fd, buf, len) < 0 ? -errno : 0;
+}
+
+int procfs_render(enum procfs_file file, pid_t pid, struct cred_t *cred)
+{
+	int err = -EINVAL;
+
+	int fd = memfd_create("remainroot-procfs", MFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	switch (file) {
+		case PROCFS_STATUS:
+			err = render_status(fd, pid, cred);
+			break;
+		case PROCFS_UID_MAP:
+		case PROCFS_GID_MAP:
+			err = render_id_map(fd);
+			break;
+		case PROCFS_NONE:
+			break;
+	}
+
+	if (err < 0) {
+		close(fd);
+		return err;
+	}
+	return fd;
+}
@@ -0,0 +1,46 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(CORE_PROCFS_H)
+#define CORE_PROCFS_H
+
+#include <sys/types.h>
+#include "core/cred.h"
+
+/* The files in /proc/<pid> that we lie about. */
+enum procfs_file {
+	PROCFS_NONE = 0,
+	PROCFS_STATUS,
+	PROCFS_UID_MAP,
+	PROCFS_GID_MAP,
+};
+
+/*
+ * Figures out whether path is one of the files we lie about, and which
+ * process it belongs to. self is the process doing the lookup, which is
+ * what /proc/self and /proc/thread-self refer to.
+ */
+enum procfs_file procfs_parse(const char *path, pid_t self, pid_t *pid);
+
+/*
+ * Generates the contents of file for pid (which has the credentials cred),
+ * returning a memfd with the contents or -errno on failure.
+ */
+int procfs_render(enum procfs_file file, pid_t pid, struct cred_t *cred);
+
+#endif /* !defined(CORE_PROCFS_H) */
@@ -0,0 +1,143 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * rlimit.c fakes raising hard resource limits. Lots of servers (nginx,
+ * PostgreSQL, ...) raise RLIMIT_NOFILE and friends when run as root, and
+ * quietly scale themselves down if that fails. Since we can't actually
+ * raise anything past the real hard limit, the kernel gets as much as it
+ * allows and the process is told that it got what it asked for.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "core/cred.h"
+#include "core/rlimit.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static bool log_clamps;
+
+void rlimit_log_clamps(void)
+{
+	log_clamps = true;
+}
+
+/* /proc/sys/fs/nr_open, which even CAP_SYS_RESOURCE can't go past. */
+static rlim_t nr_open(void)
+{
+	static rlim_t value;
+
+	if (!value) {
+		unsigned long n = 1024 * 1024;
+		FILE *f = fopen("/proc/sys/fs/nr_open", "re");
+		if (f) {
+			if (fscanf(f, "%lu", &n) != 1)
+				n = 1024 * 1024;
+			fclose(f);
+		}
+		value = n;
+	}
+	return value;
+}
+
+int rlimit_permission(struct cred_t *current, struct cred_t *target)
+{
+	if (current == target)
+		return 0;
+
+	bool match = current->uid == target->euid && current->uid == target->suid &&
+	             current->uid == target->uid && current->gid == target->egid &&
+	             current->gid == target->sgid && current->gid == target->gid;
+	if (!match && !cred_capable(current, CAP_SYS_RESOURCE))
+		return -EPERM;
+	return 0;
+}
+
+int rlimit_set(struct rlimit_t *limits, struct cred_t *current, int resource,
+               const struct rlimit *real, const struct rlimit *new,
+               struct rlimit *old, struct rlimit *apply)
+{
+	if (resource < 0 || resource >= RLIM_NLIMITS)
+		return -EINVAL;
+
+	struct rlimit *cur = &limits->rlim[resource];
+	if (!rlimit_faked(limits, resource))
+		*cur = *real;
+
+	if (new) {
+		if (new->rlim_cur > new->rlim_max)
+			return -EINVAL;
+		if (resource == RLIMIT_NOFILE && new->rlim_max > nr_open())
+			return -EPERM;
+		if (new->rlim_max > cur->rlim_max && !cred_capable(current, CAP_SYS_RESOURCE))
+			return -EPERM;
+	}
+
+	if (old)
+		*old = *cur;
+	if (!new)
+		return 0;
+
+	/* Anything the kernel will take as-is doesn't need faking. */
+	*cur = *new;
+	*apply = *new;
+	if (new->rlim_max <= real->rlim_max) {
+		limits->faked &= ~(1U << resource);
+		return 0;
+	}
+
+	limits->faked |= 1U << resource;
+	apply->rlim_max = real->rlim_max;
+	apply->rlim_cur = MIN(new->rlim_cur, real->rlim_max);
+	return 0;
+}
+
+static const char *rlimit_names[RLIM_NLIMITS] = {
+	[RLIMIT_CPU]        = "RLIMIT_CPU",
+	[RLIMIT_FSIZE]      = "RLIMIT_FSIZE",
+	[RLIMIT_DATA]       = "RLIMIT_DATA",
+	[RLIMIT_STACK]      = "RLIMIT_STACK",
+	[RLIMIT_CORE]       = "RLIMIT_CORE",
+	[RLIMIT_RSS]        = "RLIMIT_RSS",
+	[RLIMIT_NPROC]      = "RLIMIT_NPROC",
+	[RLIMIT_NOFILE]     = "RLIMIT_NOFILE",
+	[RLIMIT_MEMLOCK]    = "RLIMIT_MEMLOCK",
+	[RLIMIT_AS]         = "RLIMIT_AS",
+	[RLIMIT_LOCKS]      = "RLIMIT_LOCKS",
+	[RLIMIT_SIGPENDING] = "RLIMIT_SIGPENDING",
+	[RLIMIT_MSGQUEUE]   = "RLIMIT_MSGQUEUE",
+	[RLIMIT_NICE]       = "RLIMIT_NICE",
+	[RLIMIT_RTPRIO]     = "RLIMIT_RTPRIO",
+	[RLIMIT_RTTIME]     = "RLIMIT_RTTIME",
+};
+
+void rlimit_clamped(pid_t pid, int resource, const struct rlimit *want, const struct rlimit *got)
+{
+	if (!log_clamps)
+		return;
+
+	warn("pid %d: %s clamped to {%llu, %llu} (asked for {%llu, %llu})", pid, rlimit_names[resource],
+	     (unsigned long long) got->rlim_cur, (unsigned long long) got->rlim_max,
+	     (unsigned long long) want->rlim_cur, (unsigned long long) want->rlim_max);
+}
@@ -0,0 +1,70 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(CORE_RLIMIT_H)
+#define CORE_RLIMIT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "core/cred.h"
+
+/*
+ * rlimit_t is the faked resource limits of a process. Raising a hard limit
+ * needs CAP_SYS_RESOURCE, which we don't really have. So a raise past the
+ * real hard limit is recorded here (and reported back by getrlimit(2)),
+ * while the kernel is given the highest limit that it will allow.
+ *
+ * The kernel shares limits between all threads of a process, so only the
+ * thread group leader's copy is used (see ptrace_leader).
+ */
+struct rlimit_t {
+	/* Which resources (as a bitmask) have faked limits. */
+	uint32_t faked;
+	struct rlimit rlim[RLIM_NLIMITS];
+};
+
+/* Warn whenever a limit has to be clamped to what the kernel allows. */
+void rlimit_log_clamps(void);
+
+/* Whether resource is faked, in which case its limits are in limits->rlim. */
+static inline bool rlimit_faked(struct rlimit_t *limits, int resource)
+{
+	return limits->faked & (1U << resource);
+}
+
+/*
+ * Mirrors check_prlimit_permission(), for current changing the limits of
+ * a process with the credentials target. Returns -errno on failure.
+ */
+int rlimit_permission(struct cred_t *current, struct cred_t *target);
+
+/*
+ * Mirrors do_prlimit() against the faked limits. real is the real limit of
+ * resource. If new is set, the limit is changed and *apply is set to what
+ * the kernel should be given instead. If old is set, it's filled in with
+ * the (faked) limit from before the change. Returns -errno on failure.
+ */
+int rlimit_set(struct rlimit_t *limits, struct cred_t *current, int resource,
+               const struct rlimit *real, const struct rlimit *new,
+               struct rlimit *old, struct rlimit *apply);
+
+/* Logs that pid asked for want but only got got, if rlimit_log_clamps was called. */
+void rlimit_clamped(pid_t pid, int resource, const struct rlimit *want, const struct rlimit *got);
+
+#endif /* !defined(CORE_RLIMIT_H) */
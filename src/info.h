@@ -38,9 +38,48 @@
 "  -L, --license           show the license information\n" \
 "  -s, --shim-type <shim>  which shim method to use on the program\n" \
 "                          (valid options are 'ptrace')\n" \
+"  -S, --state-file <path> keep faked file ownership in <path>, so that it\n" \
+"                          persists across runs\n" \
+"  -X, --xattr             keep faked file ownership in the\n" \
+"                          user.rootlesscontainers xattr of each file\n" \
+"  -R, --log-rlimits       warn whenever a raised resource limit has to be\n" \
+"                          clamped to what the kernel allows\n" \
+"  -c, --stats             print how much time was spent tracing each\n" \
+"                          syscall and executable once <program> exits\n" \
+"  -m, --metrics <path>    export metrics (in the Prometheus text format)\n" \
+"                          to the file <path>, or serve them on a socket\n" \
+"                          if <path> is unix:<socket>\n" \
+"  -M, --metrics-interval <seconds>\n" \
+"                          how often to rewrite the metrics file\n" \
+"                          (the default is 10)\n" \
+"  -r, --record <path>     log every emulated credential syscall to <path>,\n" \
+"                          for remainroot-replay\n" \
+"  -w, --spin <usec>       poll for up to <usec> microseconds after each\n" \
+"                          stop before blocking, which cuts the latency of\n" \
+"                          syscall-heavy tracees at the cost of CPU time\n" \
+"  -U, --userns[=mount]    run <program> in a new user namespace (and mount\n" \
+"                          namespace, if requested) with only our uid and\n" \
+"                          gid mapped to root, rather than in an existing\n" \
+"                          rootless container\n" \
+"  -D, --daemon <socket>   rather than running <program>, serve launchers\n" \
+"                          that connect to <socket> with --connect, each\n" \
+"                          with faked file ownership of its own\n" \
+"  -j, --workers <n>       how many tracer processes --daemon uses\n" \
+"                          (the default is 1)\n" \
+"  -C, --connect <socket>  have the --daemon listening on <socket> trace\n" \
+"                          <program>, rather than tracing it ourselves\n" \
+"                          (only if it's in the same user and pid\n" \
+"                          namespaces as we are)\n" \
+"  -K, --control <socket>  accept commands on <socket> to list tracees and\n" \
+"                          their credentials (list, dump), or to stop and\n" \
+"                          start tracing a subtree (detach <pid>,\n" \
+"                          reattach <pid>)\n" \
 "\n" \
 "The remaining arguments are taken to be the program name and arguments\n" \
-"to be fooled by this program.\n"
+"to be fooled by this program.\n" \
+"\n" \
+"If we are already being traced by remainroot, <program> is run directly\n" \
+"with new credentials from the outer remainroot, which does the tracing.\n"
 
 #define REMAINROOT_LICENSE \
 PACKAGE ": a shim to trick code to run in a rootless container\n" \
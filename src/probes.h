@@ -0,0 +1,70 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * probes.h wraps the USDT probes from <sys/sdt.h>, which are a single
+ * nop each until something like perf, bpftrace or systemtap attaches to
+ * them. They're all in the "remainroot" provider, and a double underscore
+ * in a name shows up as a dash. If we're built without <sys/sdt.h>, the
+ * probes (and their arguments) disappear entirely.
+ *
+ * ptrace.c:
+ *   stop(pid, status, kind)              waitpid(2) gave us a stop, kind is a PROBE_STOP_*
+ *   shim__entry(pid, number)             about to run the shim for a syscall
+ *   shim__return(pid, number, err, ret)  the shim is done
+ *   shim__exit__entry(pid, number)       the same, for shims run on syscall exit
+ *   shim__exit__return(pid, number, err, ret)
+ *   return__faked(pid, number, ret)      the syscall's return value was replaced
+ *   clone(pid, child)                    a new child is being tracked
+ *   exec(pid, former)                    an execve(2) finished
+ *   exit(pid, status)                    a tracee was reaped (after a
+ *                                        stop of kind PROBE_STOP_EXIT)
+ *
+ * core/cred.c:
+ *   cred__commit(version, uid, euid, gid, egid)  faked credentials changed
+ */
+
+#if !defined(REMAINROOT_PROBES_H)
+#define REMAINROOT_PROBES_H
+
+#include "config.h"
+
+/* The kinds of stop (for the stop probe). */
+#define PROBE_STOP_SYSCALL_ENTRY 0
+#define PROBE_STOP_SYSCALL_EXIT  1
+#define PROBE_STOP_EVENT         2
+#define PROBE_STOP_SIGNAL        3
+#define PROBE_STOP_EXIT          4
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+
+#define PROBE1(name, a) DTRACE_PROBE1(remainroot, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(remainroot, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(remainroot, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(remainroot, name, a, b, c, d)
+#define PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(remainroot, name, a, b, c, d, e)
+#else
+#define PROBE1(name, ...) do {} while (0)
+#define PROBE2 PROBE1
+#define PROBE3 PROBE1
+#define PROBE4 PROBE1
+#define PROBE5 PROBE1
+#endif /* defined(HAVE_SYS_SDT_H) */
+
+#endif /* !defined(REMAINROOT_PROBES_H) */
@@ -20,22 +20,37 @@
 
 #define _GNU_SOURCE
 #include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <errno.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 
 #include "config.h"
 #include "common.h"
+#include "probes.h"
+#include "shims.h"
+#include "ptrace/control.h"
+#include "ptrace/daemon.h"
 #include "ptrace/generic.h"
 #include "ptrace/generic-shims.h"
+#include "ptrace/metrics.h"
+#include "ptrace/recorder.h"
+#include "ptrace/stats.h"
+#include "ptrace/wait.h"
 #include "ohmic/ohmic.h"
 #include "core/proc.h"
+#include "core/file.h"
 
 /*
  * A mapping from pid -> proc_t. Threads share the same context, but there
@@ -44,19 +59,41 @@
  */
 static struct ohm_t *pid_hm;
 
+/*
+ * Processes that were detached with --control, which keep their state in
+ * case they're reattached. We aren't told when these exit (see trace_prune).
+ */
+static struct ohm_t *detached_hm;
+
 static void ptrace_init(void) __attribute__((constructor));
 static void ptrace_init(void)
 {
 	/* XXX: Do we need to resize this at any point? */
 	pid_hm = ohm_init(4096, ohm_hash);
+	detached_hm = ohm_init(64, ohm_hash);
 }
 
 static void ptrace_exit(void) __attribute__((destructor));
 static void ptrace_exit(void)
 {
+	ohm_free(detached_hm);
 	ohm_free(pid_hm);
 }
 
+struct proc_t *ptrace_proc(pid_t pid)
+{
+	return ohm_search(pid_hm, &pid, sizeof(pid_t));
+}
+
+struct proc_t *ptrace_leader(struct proc_t *proc)
+{
+	if (!proc->tgid || proc->tgid == proc->pid)
+		return proc;
+
+	struct proc_t *leader = ohm_search(pid_hm, &proc->tgid, sizeof(pid_t));
+	return leader ? leader : proc;
+}
+
 static bool still_tracing(void)
 {
 	return ohm_iter_init(pid_hm).key != NULL;
@@ -71,6 +108,10 @@ static void tracee(int argc, char **argv)
 	if (raise(SIGSTOP))
 		die("child: raise(SIGSTOP) failed: %m");
 
+	char tracer[16];
+	snprintf(tracer, sizeof(tracer), "%d", getppid());
+	setenv(SUPERVISOR_ENV, tracer, 1);
+
 	/* Start the process. */
 	execvp(argv[0], argv);
 
@@ -78,130 +119,49 @@ static void tracee(int argc, char **argv)
 	die("tracee start failed: %m");
 }
 
-static int trace_syscall(pid_t *pid, int *ret)
+/* Restarts a stopped tracee, until its next syscall entry or exit. */
+static void trace_resume(pid_t pid, int sig)
 {
-	int status;
-
-	/* We restart tracing the process that we last hit. */
-	if (*pid) {
-		if (ptrace(PTRACE_SYSCALL, *pid, NULL, NULL) < 0) {
-			if (errno == ESRCH)
-				ohm_remove(pid_hm, pid, sizeof(pid_t));
-			die("ptrace(syscall) failed: %m");
-		}
-	}
-
-	/* Loop until we get a syscall trace. */
-	while (still_tracing()) {
-		/*
-		 * While this isn't _explicitly_ mentioned in the documentation, ptrace
-		 * is implemented such that the tracer is a pseudo-parent of all
-		 * tracees. That means that a process cannot ever become a non-"child"
-		 * process and using waitpid(-1, ...) is totally fine. At least, that's
-		 * what I'm going to tell myself at night.
-		 */
-		*pid = waitpid(-1, &status, 0);
-		if (*pid < 0)
-			die("waitpid failed: %m");
-
-		if (ret)
-			*ret = status;
-
-		/* Process is dead, remove it from the pool. */
-		if (WIFEXITED(status)) {
-			ohm_remove(pid_hm, pid, sizeof(pid_t));
-			continue;
-		}
-
-		/* We're in a syscall. */
-		if (WIFSTOPPED(status) && WSTOPSIG(status) & 0x80)
-			return 0;
-
-		/* We just hit a fork. */
-		if (((status >> 8) & SIGTRAP) == SIGTRAP && (status >> 8) != SIGTRAP)
-			return 0;
-
-		/* Restart tracing, it wasn't the state we wanted. */
-		if (ptrace(PTRACE_SYSCALL, *pid, NULL, NULL) < 0) {
-			if (errno == ESRCH) {
-				ohm_remove(pid_hm, pid, sizeof(pid_t));
-				continue;
-			}
-			die("ptrace(syscall) failed: %m");
-		}
-	}
-
-	/* She's done. */
-	return 1;
+	/*
+	 * If the process was killed while stopped, we'll get the exit status
+	 * from waitpid(2) and clean up there.
+	 */
+	if (ptrace(PTRACE_SYSCALL, pid, NULL, sig) < 0 && errno != ESRCH)
+		die("ptrace(syscall) failed: %m");
 }
 
 /* TODO: Deal with the case where TRACESYSGOOD isn't defined. */
 #define TRACE_FLAGS (PTRACE_O_EXITKILL | PTRACE_O_TRACECLONE | \
 	                 PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | \
-	                 PTRACE_O_TRACESYSGOOD)
+	                 PTRACE_O_TRACEEXEC | PTRACE_O_TRACESYSGOOD)
 
-static void tracer(pid_t pid)
+static void syscall_enter(struct proc_t *proc, pid_t pid)
 {
-	int status = 0;
+	struct syscall_t *syscall = &proc->syscall;
+	int err;
 
-	/* Wait for child to be ready for us to attach. */
-	if (waitpid(pid, &status, 0) < 0)
-		die("waitpid failed: %m");
-	if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP) {
-		kill(pid, SIGKILL);
-		die("tracer: unexpected wait status: %x", status);
-	}
-	if (ptrace(PTRACE_SETOPTIONS, pid, 0, TRACE_FLAGS) < 0)
-		die("ptrace(setoptions) failed: %m");
+	long number = ptrace_syscall(pid);
+	if (number < 0)
+		die("ptrace_syscall(%d) failed: %m", pid);
 
-	/* Add the initial process to the pool. */
-	struct proc_t init = {0};
-	proc_new(&init);
-	init.pid = pid;
-	if (!ohm_insert(pid_hm, &pid, sizeof(pid_t), &init, sizeof(struct proc_t)))
-		die("ohm_insert(init-%d) failed", pid);
+	*syscall = (struct syscall_t) {
+		.active = true,
+		.number = number,
+	};
 
 	/*
-	 * Main tracing loop. We wait until the process is stopped, and then we
-	 * evaluate what to do. Most of the complications result because ptrace(2)
-	 * doesn't tell us what syscall we are returning from.
+	 * Calculates and modifies all of the relevant state. Note that the
+	 * kernel still gets to run the syscall, we just replace its return
+	 * value on exit.
 	 */
-	while (still_tracing()) {
-		int status;
-		struct proc_t *proc;
-
-		/* --> syscall() */
-		if (trace_syscall(&pid, &status))
-			break;
-
-		/* Get the proc_t for the pid. */
-		proc = ohm_search(pid_hm, &pid, sizeof(pid_t));
-		if (!proc)
-			die("ohm_search(%d) failed on traced pid", pid);
-		if (proc->pid != pid)
-			die("pid_hm corrupted -- ohm_search(%d).pid = %d\n", pid, proc->pid);
-
-		long number = ptrace_syscall(pid);
-		if (number < 0)
-			die("ptrace_syscall(%d) failed: %m", pid);
-
-		/* TODO: Remove need_replace. */
-		bool need_replace = true;
-		uintptr_t ret = 0;
-
-		/*
-		 * Calculates and modifies all of the relevant state.
-		 * XXX: This should probably after <--syscall(), so that we can
-		 * completely ignore what the kernel decided.
-		 *
-		 * Also, this code is ugly.
-		 */
-		switch (number) {
+	switch (number) {
 #define SYSCALL(func) \
-			case SYS_ ## func: \
-				if (ptrace_rr_ ## func(proc, pid, &ret) < 0) \
-					die("ptrace_syscall_%s failed: %m\n", "" # func); \
-				break;
+		case SYS_ ## func: \
+			PROBE2(shim__entry, pid, number); \
+			err = ptrace_rr_ ## func(proc, pid, &syscall->ret); \
+			if (err < 0) \
+				die("ptrace_syscall_%s failed: %m\n", "" # func); \
+			break;
 #define SYSCALL0(type, func, ...) SYSCALL(func)
 #define SYSCALL1(type, func, ...) SYSCALL(func)
 #define SYSCALL2(type, func, ...) SYSCALL(func)
@@ -212,6 +172,10 @@ static void tracer(pid_t pid)
 #define LIBCALL0(...)
 #define LIBCALL1 LIBCALL0
 #include "core/cred.h"
+#include "core/file.h"
+OBSERVED_SYSCALLS(SYSCALL)
+PROC_SYSCALLS(SYSCALL)
+#undef SYSCALL
 #undef SYSCALL0
 #undef SYSCALL1
 #undef SYSCALL2
@@ -221,68 +185,761 @@ static void tracer(pid_t pid)
 #undef SYSCALL6
 #undef LIBCALL0
 #undef LIBCALL1
+		default:
+			return;
+	}
+
+	PROBE4(shim__return, pid, number, err, syscall->ret);
+	syscall->replace = err == SHIM_EMULATE;
+
+	if (recording && syscall->replace)
+		record_syscall(pid, number, syscall->ret);
+}
+
+static void syscall_exit(struct proc_t *proc, pid_t pid)
+{
+	struct syscall_t *syscall = &proc->syscall;
+	int err = SHIM_PASS;
+
+	uintptr_t ret = syscall->ret;
+	if (!syscall->replace)
+		ret = ptrace_retval(pid);
+
+	switch (syscall->number) {
+#define OBSERVE(func) \
+		case SYS_ ## func: \
+			PROBE2(shim__exit__entry, pid, syscall->number); \
+			err = ptrace_rr_ ## func ## _exit(proc, pid, &ret); \
+			if (err < 0) \
+				die("ptrace_syscall_%s_exit failed: %m\n", "" # func); \
+			PROBE4(shim__exit__return, pid, syscall->number, err, ret); \
+			break;
+OBSERVED_SYSCALLS(OBSERVE)
+#undef OBSERVE
+	}
+
+	/*
+	 * Replace syscall return value. We have to do this after
+	 * ret-from-syscall. XXX: There should be some logic to deal
+	 * with errors reported from the kernel.
+	 */
+	if (syscall->replace || err == SHIM_EMULATE) {
+		if (ptrace_return(pid, ret) < 0)
+			die("ptrace_return(%lu): %m", ret);
+		PROBE3(return__faked, pid, syscall->number, ret);
+	}
+
+	/* Only so that --stats can tell whether the syscall was emulated. */
+	syscall->replace = syscall->replace || err == SHIM_EMULATE;
+	syscall->active = false;
+}
+
+/*
+ * Detaching (see trace_detach) has to wait until the tracee stops somewhere
+ * that we aren't in the middle of emulating anything, so we stop it with a
+ * SIGSTOP of our own and let go when that comes through.
+ */
+static void trace_stop_detach(struct proc_t *proc)
+{
+	proc->flags |= PROC_DETACHING;
+	syscall(SYS_tkill, proc->pid, SIGSTOP);
+}
+
+/* Anything created by a tracee we're detaching from has to go too. */
+static void trace_inherit_detach(struct proc_t *child, struct proc_t *parent)
+{
+	if (parent->flags & PROC_DETACHING)
+		trace_stop_detach(child);
+}
+
+/*
+ * Reads the start time of pid (field 22 of /proc/<pid>/stat), or 0 if it's
+ * gone. Together with the pid, this identifies a process.
+ */
+static unsigned long long proc_starttime(pid_t pid)
+{
+	char path[PATH_MAX], line[1024];
+	unsigned long long starttime = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	FILE *stat = fopen(path, "re");
+	if (!stat)
+		return 0;
+
+	/* The name (field 2) can contain anything, so count from its last ')'. */
+	char *field = fgets(line, sizeof(line), stat) ? strrchr(line, ')') : NULL;
+	for (int i = 2; field && i < 22; i++)
+		field = strchr(field + 1, ' ');
+	if (field)
+		starttime = strtoull(field + 1, NULL, 10);
+	fclose(stat);
+	return starttime;
+}
+
+/*
+ * Whether proc stopped for the SIGSTOP that trace_stop_detach sent, rather
+ * than one from anyone else (which has to be passed on). Only a tracee that
+ * we're detaching from can have one of ours.
+ */
+static bool trace_detach_stop(struct proc_t *proc, int sig, siginfo_t *siginfo)
+{
+	if (!(proc->flags & PROC_DETACHING) || sig != SIGSTOP || siginfo->si_code != SI_TKILL)
+		return false;
+
+	/* A tracee in a pid namespace below ours sees us as pid 0. */
+	return siginfo->si_pid == getpid() || (!siginfo->si_pid && !ptrace_same_ns(proc->pid, "pid"));
+}
+
+/* Lets go of a tracee, which has stopped for our SIGSTOP (which it never sees). */
+static void trace_release(struct proc_t *proc, pid_t pid)
+{
+	/* We aren't told when it exits, so remember which process it was. */
+	proc->starttime = proc_starttime(pid);
+	if (ptrace(PTRACE_DETACH, pid, NULL, 0) < 0 && errno != ESRCH)
+		warn("ptrace(detach, %d) failed: %m", pid);
+
+	proc->flags &= ~PROC_DETACHING;
+	proc->syscall = (struct syscall_t) {0};
+	if (!ohm_insert(detached_hm, &pid, sizeof(pid_t), proc, sizeof(struct proc_t)))
+		warn("ohm_insert(detached-%d) failed", pid);
+	ohm_remove(pid_hm, &pid, sizeof(pid_t));
+}
+
+/* Reads an integer field (such as "Tgid:") of /proc/<pid>/status, or def. */
+static int proc_status(pid_t pid, const char *field, int def)
+{
+	char path[PATH_MAX], line[256];
+	size_t len = strlen(field);
+	int value = def;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	FILE *status = fopen(path, "re");
+	if (!status)
+		return def;
+	while (fgets(line, sizeof(line), status)) {
+		if (!strncmp(line, field, len)) {
+			if (sscanf(line + len, "%d", &value) != 1)
+				value = def;
+			break;
+		}
+	}
+	fclose(status);
+	return value;
+}
+
+/* A fork(2) or clone(2) by proc just finished, so track the new child. */
+static void trace_clone(struct proc_t *proc, pid_t pid, bool clone)
+{
+	pid_t child_pid;
+	if (ptrace(PTRACE_GETEVENTMSG, pid, NULL, &child_pid) < 0)
+		die("ptrace(geteventmsg): %m");
+
+	/*
+	 * Only clone(2) can create a thread in the same process, and the event
+	 * doesn't say whether it did.
+	 */
+	pid_t tgid = clone ? proc_status(child_pid, "Tgid:", child_pid) : child_pid;
+	struct rlimit_t *rlimit = &ptrace_leader(proc)->rlimit;
+
+	/*
+	 * The child may have stopped before we were told about it, in which
+	 * case it's been waiting for us to fill in its credentials.
+	 */
+	PROBE2(clone, pid, child_pid);
+	if (recording)
+		record_clone(pid, child_pid);
+
+	proc->children++;
+
+	struct proc_t *child = ohm_search(pid_hm, &child_pid, sizeof(pid_t));
+	if (child) {
+		proc_clone(child, proc);
+		file_domain_get(child->files);
+		child->pid = child_pid;
+		child->tgid = tgid;
+		child->rlimit = *rlimit;
+		trace_inherit_detach(child, proc);
+		trace_resume(child_pid, 0);
+		return;
+	}
+
+	struct proc_t new = {0};
+	proc_clone(&new, proc);
+	file_domain_get(new.files);
+	new.pid = child_pid;
+	new.tgid = tgid;
+	new.rlimit = *rlimit;
+	new.flags = PROC_STARTING;
+	trace_inherit_detach(&new, proc);
+
+	if (!ohm_insert(pid_hm, &child_pid, sizeof(pid_t), &new, sizeof(struct proc_t)))
+		die("ohm_insert(child-%d) failed", child_pid);
+}
+
+/*
+ * proc is gone, so its parent has one less child, and its own children
+ * (if it had any) now belong to ppid.
+ */
+static void trace_reparent(struct proc_t *proc, pid_t ppid)
+{
+	struct proc_t *parent = proc->ppid ? ohm_search(pid_hm, &proc->ppid, sizeof(pid_t)) : NULL;
+	if (parent && parent->children)
+		parent->children--;
+	if (!proc->children)
+		return;
+
+	struct proc_t *heir = ppid ? ohm_search(pid_hm, &ppid, sizeof(pid_t)) : NULL;
+	for (struct ohm_iter iter = ohm_iter_init(pid_hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *child = iter.value;
+		if (child->ppid != proc->pid)
+			continue;
+		child->ppid = ppid;
+		if (heir)
+			heir->children++;
+	}
+}
+
+/* Whether pid has PR_SET_NO_NEW_PRIVS set, which we leave to the kernel. */
+static bool no_new_privs(pid_t pid)
+{
+	return proc_status(pid, "NoNewPrivs:", 0);
+}
+
+/* An execve(2) just succeeded, possibly from a thread other than the leader. */
+static void trace_exec(struct proc_t *proc, pid_t pid)
+{
+	pid_t former_pid;
+	if (ptrace(PTRACE_GETEVENTMSG, pid, NULL, &former_pid) < 0)
+		die("ptrace(geteventmsg): %m");
+
+	/*
+	 * The thread that called execve(2) has taken over the leader's pid (but
+	 * not its place in the tree), and anything it created is now the
+	 * leader's.
+	 */
+	if (former_pid != pid) {
+		struct proc_t *former = ohm_search(pid_hm, &former_pid, sizeof(pid_t));
+		if (former) {
+			pid_t ppid = proc->ppid;
+			unsigned int children = proc->children;
+			struct rlimit_t rlimit = proc->rlimit;
+
+			*proc = *former;
+			proc->pid = pid;
+			proc->ppid = ppid;
+			proc->children = children;
+			proc->rlimit = rlimit;
+			trace_reparent(former, pid);
+			file_domain_put(former->files);
+			ohm_remove(pid_hm, &former_pid, sizeof(pid_t));
+		}
+	}
+
+	/* The new program may be privileged, by way of faked metadata or not. */
+	char path[PATH_MAX];
+	struct cred_bprm_t bprm;
+	snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+	file_exec(path, &bprm);
+	if (bprm.setuid || bprm.setgid || bprm.fcaps)
+		bprm.no_new_privs = no_new_privs(pid);
+
+	cred_exec(&proc->cred, &bprm);
+	PROBE2(exec, pid, former_pid);
+	if (recording)
+		record_exec(pid, former_pid, &bprm);
+
+	if (stats_enabled) {
+		char exe[PATH_MAX];
+		ssize_t len = readlink(path, exe, sizeof(exe) - 1);
+		if (len > 0) {
+			exe[len] = '\0';
+			proc->exe = stats_exe(exe);
+		}
+	}
+}
+
+static void trace_stop(pid_t pid, int status)
+{
+	/* Process is dead, remove it from the pool. */
+	if (WIFEXITED(status) || WIFSIGNALED(status)) {
+		PROBE3(stop, pid, status, PROBE_STOP_EXIT);
+		PROBE2(exit, pid, status);
+		if (recording)
+			record_exit(pid);
+		struct proc_t *proc = ohm_search(pid_hm, &pid, sizeof(pid_t));
+		if (proc) {
+			trace_reparent(proc, proc->ppid);
+			file_domain_put(proc->files);
+		}
+		ohm_remove(pid_hm, &pid, sizeof(pid_t));
+		return;
+	}
+
+	if (!WIFSTOPPED(status))
+		return;
+
+	/*
+	 * A new child can stop before its parent tells us that it exists. We
+	 * keep it stopped until we know what its credentials should be.
+	 */
+	struct proc_t *proc = ohm_search(pid_hm, &pid, sizeof(pid_t));
+	if (!proc) {
+		struct proc_t orphan = {
+			.pid = pid,
+			.flags = PROC_ORPHAN,
+		};
+		if (!ohm_insert(pid_hm, &pid, sizeof(pid_t), &orphan, sizeof(struct proc_t)))
+			die("ohm_insert(orphan-%d) failed", pid);
+		return;
+	}
+	if (proc->pid != pid)
+		die("pid_hm corrupted -- ohm_search(%d).pid = %d\n", pid, proc->pid);
+	file_domain_use(proc->files);
+
+	int sig = WSTOPSIG(status);
+	int event = status >> 16;
+
+	/* We're in a syscall. */
+	if (sig == (SIGTRAP | 0x80)) {
+		PROBE3(stop, pid, status, proc->syscall.active ? PROBE_STOP_SYSCALL_EXIT : PROBE_STOP_SYSCALL_ENTRY);
+		if (!proc->syscall.active)
+			syscall_enter(proc, pid);
+		else
+			syscall_exit(proc, pid);
+		trace_resume(pid, 0);
+		return;
+	}
+
+	/* We just hit a ptrace event. */
+	if (sig == SIGTRAP && event) {
+		PROBE3(stop, pid, status, PROBE_STOP_EVENT);
+		switch (event) {
+			case PTRACE_EVENT_CLONE:
+			case PTRACE_EVENT_VFORK:
+			case PTRACE_EVENT_FORK:
+				trace_clone(proc, pid, event == PTRACE_EVENT_CLONE);
 				break;
-			default:
-				need_replace = false;
+			case PTRACE_EVENT_EXEC:
+				trace_exec(proc, pid);
 				break;
 		}
+		trace_resume(pid, 0);
+		return;
+	}
+
+	/* New children start with a SIGSTOP, which they didn't ask for. */
+	if (proc->flags & PROC_STARTING && sig == SIGSTOP) {
+		proc->flags &= ~PROC_STARTING;
+		trace_resume(pid, 0);
+		return;
+	}
+
+	/*
+	 * Otherwise it's a real signal, which we have to pass on. Group-stops
+	 * look the same but don't have any siginfo, and must not be passed on.
+	 */
+	PROBE3(stop, pid, status, PROBE_STOP_SIGNAL);
+	siginfo_t siginfo;
+	if (ptrace(PTRACE_GETSIGINFO, pid, NULL, &siginfo) < 0)
+		sig = 0;
+
+	/* Unless it's the SIGSTOP we sent so that we could let go of it. */
+	if (!event && trace_detach_stop(proc, sig, &siginfo)) {
+		trace_release(proc, pid);
+		return;
+	}
+	trace_resume(pid, sig);
+}
+
+/* Renders a metrics snapshot (see ptrace/metrics.c). */
+static void trace_metrics(FILE *out)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	             usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	size_t state = pid_hm->count * (sizeof(struct ohm_node) + sizeof(pid_t) + sizeof(struct proc_t)) +
+	               pid_hm->size * sizeof(struct ohm_node *);
+
+	fprintf(out, "# HELP remainroot_tracees Processes and threads being traced.\n");
+	fprintf(out, "# TYPE remainroot_tracees gauge\n");
+	fprintf(out, "remainroot_tracees %d\n", pid_hm->count);
+	fprintf(out, "# HELP remainroot_tracee_state_bytes Memory used by per-process state.\n");
+	fprintf(out, "# TYPE remainroot_tracee_state_bytes gauge\n");
+	fprintf(out, "remainroot_tracee_state_bytes %zu\n", state);
+	fprintf(out, "# HELP remainroot_tracer_cpu_seconds_total CPU time used by the tracer.\n");
+	fprintf(out, "# TYPE remainroot_tracer_cpu_seconds_total counter\n");
+	fprintf(out, "remainroot_tracer_cpu_seconds_total %.6f\n", cpu);
+	stats_metrics(out);
+}
+
+/* Starts tracing a process that isn't being traced by anyone. Returns -errno. */
+static int trace_seize(pid_t pid)
+{
+	if (ptrace(PTRACE_SEIZE, pid, NULL, TRACE_FLAGS) < 0)
+		return -errno;
+
+	/*
+	 * It's still running, and only starts stopping at syscalls once we've
+	 * resumed it from a stop. The interrupt shows up as an event.
+	 */
+	if (ptrace(PTRACE_INTERRUPT, pid, NULL, NULL) < 0) {
+		int err = -errno;
+		ptrace(PTRACE_DETACH, pid, NULL, NULL);
+		return err;
+	}
+	return 0;
+}
+
+/* Whether pid is root or one of its descendants, going by the ppids in hm. */
+static bool trace_descends(struct ohm_t *hm, pid_t pid, pid_t root)
+{
+	/* The ppids can't loop, but don't bet on it. */
+	for (int depth = 0; depth <= hm->count; depth++) {
+		if (pid == root)
+			return true;
+
+		struct proc_t *proc = ohm_search(hm, &pid, sizeof(pid_t));
+		if (!proc || !proc->ppid)
+			return false;
+		pid = proc->ppid;
+	}
+	return false;
+}
+
+/*
+ * Stops tracing root and everything under it, so that it runs at native
+ * speed. Their state is kept, so trace_reattach can pick up where we left
+ * off. This only actually happens at each tracee's next stop.
+ */
+static int trace_detach(pid_t root)
+{
+	int count = 0;
+
+	if (!ohm_search(pid_hm, &root, sizeof(pid_t)))
+		return -ESRCH;
+
+	for (struct ohm_iter iter = ohm_iter_init(pid_hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *proc = iter.value;
+		if (proc->flags & PROC_DETACHING || !trace_descends(pid_hm, proc->pid, root))
+			continue;
+		trace_stop_detach(proc);
+		count++;
+	}
+	return count;
+}
+
+/* Whether a detached proc is still the process with its pid. */
+static bool trace_still_detached(struct proc_t *proc)
+{
+	unsigned long long starttime = proc_starttime(proc->pid);
+	return starttime && starttime == proc->starttime;
+}
+
+/*
+ * Forgets detached processes that have exited, which includes any whose
+ * pid now belongs to some other process.
+ */
+static void trace_prune(void)
+{
+	pid_t *pids = malloc((detached_hm->count + 1) * sizeof(pid_t));
+	if (!pids)
+		return;
+
+	/* Collect them first, since we can't remove things while iterating. */
+	int n = 0;
+	for (struct ohm_iter iter = ohm_iter_init(detached_hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *proc = iter.value;
+		if (!trace_still_detached(proc))
+			pids[n++] = proc->pid;
+	}
+	for (int i = 0; i < n; i++) {
+		struct proc_t *proc = ohm_search(detached_hm, &pids[i], sizeof(pid_t));
+		file_domain_put(proc->files);
+		ohm_remove(detached_hm, &pids[i], sizeof(pid_t));
+	}
+	free(pids);
+}
+
+/* Lets go of a process that we seized, which turned out to be the wrong one. */
+static void trace_unseize(pid_t pid)
+{
+	int status;
+
+	/* It can only be detached once the interrupt has stopped it. */
+	if (waitpid(pid, &status, __WALL) == pid && WIFSTOPPED(status))
+		ptrace(PTRACE_DETACH, pid, NULL, 0);
+}
+
+/*
+ * Starts tracing root and everything under it again, with the state they
+ * had when they were detached. Anything they created in the meantime isn't
+ * traced, since we have no idea what its credentials should be.
+ */
+static int trace_reattach(pid_t root)
+{
+	int count = 0, err = 0;
+
+	if (!ohm_search(detached_hm, &root, sizeof(pid_t)))
+		return -ESRCH;
+
+	/* Collect them first, since we can't remove things while iterating. */
+	pid_t *pids = malloc(detached_hm->count * sizeof(pid_t));
+	if (!pids)
+		return -ENOMEM;
+	int n = 0;
+	for (struct ohm_iter iter = ohm_iter_init(detached_hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *proc = iter.value;
+		if (trace_descends(detached_hm, proc->pid, root))
+			pids[n++] = proc->pid;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int ret = trace_seize(pids[i]);
+		if (ret < 0 && ret != -ESRCH) {
+			err = ret;
+			continue;
+		}
+
+		/* Once it's seized, the pid can't be reused until we've waited for it. */
+		struct proc_t *proc = ohm_search(detached_hm, &pids[i], sizeof(pid_t));
+		if (!ret && !trace_still_detached(proc)) {
+			trace_unseize(pids[i]);
+			ret = -ESRCH;
+		}
+		if (!ret) {
+			if (!ohm_insert(pid_hm, &pids[i], sizeof(pid_t), proc, sizeof(struct proc_t)))
+				die("ohm_insert(reattach-%d) failed", pids[i]);
+			count++;
+		} else {
+			file_domain_put(proc->files);
+		}
+		ohm_remove(detached_hm, &pids[i], sizeof(pid_t));
+	}
+
+	free(pids);
+	return count ? count : err;
+}
+
+static void trace_list_procs(FILE *out, struct ohm_t *hm, const char *state)
+{
+	for (struct ohm_iter iter = ohm_iter_init(hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *proc = iter.value;
+		struct cred_t *cred = &proc->cred;
+
+		fprintf(out, "%d\t%d\t%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", proc->pid, proc->ppid,
+		        proc->flags & PROC_DETACHING ? "detaching" : state,
+		        cred->uid, cred->euid, cred->suid, cred->fsuid,
+		        cred->gid, cred->egid, cred->sgid, cred->fsgid);
+	}
+}
+
+static void trace_dump_procs(FILE *out, struct ohm_t *hm, const char *state)
+{
+	for (struct ohm_iter iter = ohm_iter_init(hm); iter.key; ohm_iter_inc(&iter)) {
+		struct proc_t *proc = iter.value;
+		struct cred_t *cred = &proc->cred;
+
+		fprintf(out, "proc %d (%s)\n", proc->pid, state);
+		fprintf(out, "\tppid %d children %u flags %#x exe %u\n",
+		        proc->ppid, proc->children, proc->flags, proc->exe);
+		fprintf(out, "\tuid %u %u %u %u gid %u %u %u %u\n",
+		        cred->uid, cred->euid, cred->suid, cred->fsuid,
+		        cred->gid, cred->egid, cred->sgid, cred->fsgid);
+		fprintf(out, "\tgroups %d:", cred->ngroups);
+		for (int i = 0; i < cred->ngroups; i++)
+			fprintf(out, " %u", cred->groups[i]);
+		fprintf(out, "\n");
+		fprintf(out, "\tcaps inh %#"PRIx64" prm %#"PRIx64" eff %#"PRIx64" bnd %#"PRIx64" amb %#"PRIx64"\n",
+		        cred->cap_inheritable, cred->cap_permitted, cred->cap_effective,
+		        cred->cap_bset, cred->cap_ambient);
+		fprintf(out, "\tsecurebits %#lx version %lu rlimits %#x\n",
+		        cred->securebits, cred->version, proc->rlimit.faked);
+		if (proc->syscall.active)
+			fprintf(out, "\tsyscall %ld replace %d ret %#"PRIxPTR"\n",
+			        proc->syscall.number, proc->syscall.replace, proc->syscall.ret);
+	}
+}
+
+/*
+ * Runs a command from the control socket (see ptrace/control.c):
+ *
+ *   list            one line per tracee: pid, ppid, state and faked ids
+ *   detach <pid>    stop tracing <pid> and everything under it
+ *   reattach <pid>  start tracing a detached <pid> (and so on) again
+ *   dump            everything we know about every tracee
+ */
+static void trace_control(FILE *out, char *command)
+{
+	char *verb = strtok(command, " \t");
+	char *arg = strtok(NULL, " \t");
+	pid_t pid = arg ? atoi(arg) : 0;
+	int ret;
+
+	/* We aren't told when detached processes exit, so check now. */
+	trace_prune();
+
+	if (!verb) {
+		fprintf(out, "error: no command\n");
+	} else if (!strcmp(verb, "list")) {
+		fprintf(out, "pid\tppid\tstate\tuid\teuid\tsuid\tfsuid\tgid\tegid\tsgid\tfsgid\n");
+		trace_list_procs(out, pid_hm, "traced");
+		trace_list_procs(out, detached_hm, "detached");
+	} else if (!strcmp(verb, "dump")) {
+		fprintf(out, "tracees %d detached %d\n", pid_hm->count, detached_hm->count);
+		trace_dump_procs(out, pid_hm, "traced");
+		trace_dump_procs(out, detached_hm, "detached");
+	} else if (!strcmp(verb, "detach") || !strcmp(verb, "reattach")) {
+		if (pid <= 0)
+			ret = -EINVAL;
+		else if (!strcmp(verb, "detach"))
+			ret = trace_detach(pid);
+		else
+			ret = trace_reattach(pid);
+
+		if (ret < 0)
+			fprintf(out, "error: %s\n", strerror(-ret));
+		else
+			fprintf(out, "ok %d\n", ret);
+	} else {
+		fprintf(out, "error: unknown command: %s\n", verb);
+	}
+}
+
+/* Accounts for a stop that was dealt with, which started at start. */
+static void trace_stats(pid_t pid, int status, uint64_t start)
+{
+	struct proc_t *proc = ohm_search(pid_hm, &pid, sizeof(pid_t));
+	if (!proc || !WIFSTOPPED(status))
+		return;
+
+	uint64_t ns = stats_now() - start;
+	if (WSTOPSIG(status) != (SIGTRAP | 0x80))
+		stats_stop(proc->exe, ns);
+	else if (proc->syscall.active)
+		proc->syscall.ns = ns;
+	else
+		stats_syscall(proc->exe, proc->syscall.number, proc->syscall.replace,
+		              proc->syscall.ns + ns);
+}
+
+/*
+ * Adds the root of a new tree to the pool, with brand new credentials and
+ * the faked file metadata in files (which it takes the reference to).
+ */
+static void trace_new(pid_t pid, struct file_domain_t *files)
+{
+	struct proc_t init = {0};
+	proc_new(&init);
+	init.pid = pid;
+	init.tgid = pid;
+	init.files = files;
+	if (!ohm_insert(pid_hm, &pid, sizeof(pid_t), &init, sizeof(struct proc_t)))
+		die("ohm_insert(init-%d) failed", pid);
+
+	if (recording)
+		record_root(pid, &init.cred);
+}
+
+/* Starts tracing a launcher that was handed to us (see ptrace/daemon.c). */
+static int trace_attach(pid_t pid)
+{
+	/* Its ids and pids wouldn't mean what they do to us, and we can't translate them. */
+	if (!ptrace_same_ns(pid, "user") || !ptrace_same_ns(pid, "pid"))
+		return -EXDEV;
+
+	int err = trace_seize(pid);
+	if (err < 0)
+		return err;
+
+	/* It's a container of its own, which mustn't see what the others faked. */
+	trace_new(pid, file_domain_new());
+	return 0;
+}
+
+/*
+ * Main tracing loop. We wait until any process is stopped, and then we
+ * evaluate what to do. Most of the complications result because ptrace(2)
+ * doesn't tell us whether we're entering or returning from a syscall, so
+ * we have to keep track of that for every process.
+ *
+ * We're done once root (and everything else) is gone. Daemon workers
+ * don't have a root, and keep going until the supervisor goes away.
+ */
+static void trace_loop(pid_t root)
+{
+	pid_t pid;
+	int status;
+
+	while (still_tracing() || !root) {
+		/* Anything that arrives after this interrupts wait_stop. */
+		wait_pending = 0;
+		if (metrics_pending)
+			metrics_export(trace_metrics);
+		if (control_pending)
+			control_serve(trace_control);
+		if (daemon_pending)
+			daemon_accept(trace_attach);
+		if (!still_tracing()) {
+			daemon_idle();
+			continue;
+		}
 
-		/* <-- syscall() */
 		/*
-		 * FIXME: I'm 95% sure there's a race condition here if you
-		 *        accidentally hit a syscall entry here.
+		 * While this isn't _explicitly_ mentioned in the documentation, ptrace
+		 * is implemented such that the tracer is a pseudo-parent of all
+		 * tracees. That means that a process cannot ever become a non-"child"
+		 * process and using waitpid(-1, ...) is totally fine. At least, that's
+		 * what I'm going to tell myself at night.
 		 */
-		if (trace_syscall(&pid, &status)) {
-			/* The user called the exit syscall. */
-			if (number == SYS_exit || number == SYS_exit_group) {
-				ohm_remove(pid_hm, &pid, sizeof(pid_t));
-				pid = 0;
+		pid = wait_stop(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
 				continue;
-			}
-			die("trace_syscall failed: process died inside syscall\n");
+			die("waitpid failed: %m");
 		}
 
-		/* Get the proc_t for the pid. */
-		proc = ohm_search(pid_hm, &pid, sizeof(pid_t));
-		if (!proc)
-			die("ohm_search(%d) failed on traced pid", pid);
-		if (proc->pid != pid)
-			die("pid_hm corrupted -- ohm_search(%d).pid = %d\n", pid, proc->pid);
-
-		/* See if we just hit a clone. */
-		switch ((status >> 8) & ~SIGTRAP) {
-			case PTRACE_EVENT_CLONE << 8:
-			case PTRACE_EVENT_VFORK << 8:
-			case PTRACE_EVENT_FORK << 8:
-				{
-					pid_t trace_child;
-
-					if (ptrace(PTRACE_GETEVENTMSG, pid, NULL, &trace_child) < 0)
-						die("ptrace(getevntmsg): %m");
-
-					/* TODO: Deal with threads. We'll have to fix up the usage of ohmic. */
-					struct proc_t new = {0};
-					proc_clone(&new, proc);
-					new.pid = trace_child;
-
-					/* #yolo */
-					if (!ohm_insert(pid_hm, &trace_child, sizeof(pid_t), &new, sizeof(struct proc_t)))
-						die("ohm_insert(child-%d) failed", trace_child);
-				}
+		if (!stats_enabled) {
+			trace_stop(pid, status);
+			continue;
 		}
 
-		/*
-		 * Replace syscall return value. We have to do this after
-		 * ret-from-syscall. XXX: There should be some logic to deal
-		 * with errors reported from the kernel.
-		 */
-		if (need_replace && ptrace_return(pid, ret) < 0)
-			die("ptrace_return(%d): %m", ret);
+		uint64_t start = stats_now();
+		trace_stop(pid, status);
+		trace_stats(pid, status, start);
+		if (stats_summary && pid == root && (WIFEXITED(status) || WIFSIGNALED(status)))
+			stats_print(stderr);
 	}
 
 	exit(0);
 }
 
+static void tracer(pid_t pid)
+{
+	int status = 0;
+
+	/* Wait for child to be ready for us to attach. */
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP) {
+		kill(pid, SIGKILL);
+		die("tracer: unexpected wait status: %x", status);
+	}
+	if (ptrace(PTRACE_SETOPTIONS, pid, 0, TRACE_FLAGS) < 0)
+		die("ptrace(setoptions) failed: %m");
+
+	/* Add the initial process to the pool. */
+	trace_new(pid, NULL);
+	trace_resume(pid, 0);
+	trace_loop(pid);
+}
+
+void shim_ptrace_serve(void)
+{
+	trace_loop(0);
+}
+
 void shim_ptrace(int argc, char **argv)
 {
 	pid_t pid = fork();
@@ -31,7 +31,7 @@ long ptrace_syscall(pid_t pid)
 	return ptrace(PTRACE_PEEKUSER, pid, sizeof(long)*ORIG_RAX);
 }
 
-uintptr_t ptrace_argument(pid_t pid, int arg)
+static int argument_reg(int arg)
 {
 	int reg = 0;
 	switch (arg) {
@@ -55,8 +55,17 @@ uintptr_t ptrace_argument(pid_t pid, int arg)
 			reg = R9;
 			break;
 	}
+	return reg;
+}
 
-	return ptrace(PTRACE_PEEKUSER, pid, sizeof(long) * reg, NULL);
+uintptr_t ptrace_argument(pid_t pid, int arg)
+{
+	return ptrace(PTRACE_PEEKUSER, pid, sizeof(long) * argument_reg(arg), NULL);
+}
+
+int ptrace_set_argument(pid_t pid, int arg, uintptr_t value)
+{
+	return ptrace(PTRACE_POKEUSER, pid, sizeof(long) * argument_reg(arg), value);
 }
 
 int ptrace_return(pid_t pid, uintptr_t ret)
@@ -64,6 +73,25 @@ int ptrace_return(pid_t pid, uintptr_t ret)
 	return ptrace(PTRACE_POKEUSER, pid, sizeof(long) * RAX, ret);
 }
 
+int ptrace_skip_syscall(pid_t pid)
+{
+	return ptrace(PTRACE_POKEUSER, pid, sizeof(long) * ORIG_RAX, -1);
+}
+
+/* The System V ABI lets leaf functions use 128 bytes below %rsp. */
+#define RED_ZONE 128
+
+uintptr_t ptrace_stack_scratch(pid_t pid, size_t len)
+{
+	uintptr_t sp = ptrace(PTRACE_PEEKUSER, pid, sizeof(long) * RSP, NULL);
+	return (sp - RED_ZONE - len) & ~(uintptr_t) 15;
+}
+
+long ptrace_retval(pid_t pid)
+{
+	return ptrace(PTRACE_PEEKUSER, pid, sizeof(long) * RAX, NULL);
+}
+
 uintptr_t ptrace_deref_data(pid_t pid, uintptr_t addr)
 {
 	return ptrace(PTRACE_PEEKDATA, pid, addr, NULL);
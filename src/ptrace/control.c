@@ -0,0 +1,162 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * ptrace/control.c is the socket that --control listens on, so that a
+ * running tracer can be inspected and told to let go of (or take back)
+ * parts of the tree. Like metrics.c, connections wake the tracing loop
+ * with a signal (through wait.c) and are dealt with in between stops, so
+ * the commands (which live in ptrace.c) don't need any locking.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "control.h"
+#include "wait.h"
+
+/* Not SIGIO, which metrics.c might be using. */
+#define CONTROL_SIGNAL (SIGRTMIN + 1)
+
+/* Commands are short, and a client that's slow to send one is dropped. */
+#define COMMAND_MAX     256
+#define COMMAND_TIMEOUT 1
+
+volatile sig_atomic_t control_pending;
+
+static char *path;
+static int sock = -1;
+static pid_t owner;
+
+static void control_signal(int sig)
+{
+	control_pending = 1;
+	wait_pending = 1;
+}
+
+static void control_exit(void)
+{
+	/* Only the tracer, not a tracee that failed to exec(2). */
+	if (getpid() == owner)
+		unlink(path);
+}
+
+void control_init(const char *target)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	path = strdup(target);
+	if (!path)
+		die("control_init: out of memory");
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("control socket path too long: %s", path);
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("couldn't create control socket: %m");
+	unlink(path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, 16) < 0)
+		die("couldn't listen on %s: %m", path);
+	owner = getpid();
+	atexit(control_exit);
+
+	/* No SA_RESTART, so that the tracing loop notices. */
+	struct sigaction sa = {
+		.sa_handler = control_signal,
+	};
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(CONTROL_SIGNAL, &sa, NULL) < 0 ||
+	    fcntl(sock, F_SETOWN, getpid()) < 0 ||
+	    fcntl(sock, F_SETSIG, CONTROL_SIGNAL) < 0 ||
+	    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_ASYNC) < 0)
+		die("couldn't set up control socket: %m");
+	wait_signal(CONTROL_SIGNAL);
+}
+
+/* Reads a single line from fd, without the newline. */
+static int control_read(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len - 1) {
+		ssize_t n = recv(fd, buf + done, len - 1 - done, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+		if (memchr(buf, '\n', done))
+			break;
+	}
+
+	buf[done] = '\0';
+	char *newline = strchr(buf, '\n');
+	if (!newline)
+		return done ? 0 : -1;
+	*newline = '\0';
+	return 0;
+}
+
+void control_serve(void (*run)(FILE *out, char *command))
+{
+	struct timeval timeout = { .tv_sec = COMMAND_TIMEOUT };
+	int fd;
+
+	control_pending = 0;
+
+	while ((fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		char command[COMMAND_MAX], *buf = NULL;
+		size_t len = 0;
+
+		/* Commands can take processes away from us, so only our own user gets to. */
+		struct ucred peer;
+		socklen_t peerlen = sizeof(peer);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peerlen) < 0 || peer.uid != geteuid()) {
+			close(fd);
+			continue;
+		}
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		if (control_read(fd, command, sizeof(command)) < 0) {
+			close(fd);
+			continue;
+		}
+
+		FILE *out = open_memstream(&buf, &len);
+		if (out) {
+			run(out, command);
+			fclose(out);
+			send(fd, buf, len, MSG_NOSIGNAL);
+			free(buf);
+		}
+		close(fd);
+	}
+}
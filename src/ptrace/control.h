@@ -0,0 +1,41 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if !defined(PTRACE_CONTROL_H)
+#define PTRACE_CONTROL_H
+
+#include <signal.h>
+#include <stdio.h>
+
+/*
+ * Listens on the unix socket at path for commands from operators, one
+ * line per connection, whose output is written back before the
+ * connection is closed.
+ */
+void control_init(const char *path);
+
+/*
+ * Set (from a signal handler) when there are connections waiting. The
+ * tracing loop should call control_serve whenever it's set, which calls
+ * run with each command to write its output to out.
+ */
+extern volatile sig_atomic_t control_pending;
+void control_serve(void (*run)(FILE *out, char *command));
+
+#endif /* !defined(PTRACE_CONTROL_H) */
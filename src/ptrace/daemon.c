@@ -0,0 +1,398 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * ptrace/daemon.c lets a single long-running remainroot serve lots of
+ * short-lived containers, rather than starting a new tracer (and paying
+ * for our startup, and an idle process) for each one. The supervisor
+ * listens on a unix socket, and `remainroot --connect` (which is all a
+ * container has to run) asks it to be traced and then just execs the
+ * program, so there's no extra fork in the container either.
+ *
+ * The supervisor only accepts connections, and passes each one on (along
+ * with the launcher's pid) to a pool of worker processes in turn. Each
+ * worker is an ordinary tracer, which attaches to the launcher with
+ * PTRACE_SEIZE and traces it like any other tree, with its own faked
+ * credentials and faked file metadata (see file_domain_new). New launchers
+ * wake the worker up with a signal (through wait.c), the same way
+ * metrics.c does.
+ *
+ * The handshake between a worker and a launcher is:
+ *   worker -> launcher: the worker's pid (for PR_SET_PTRACER, with Yama)
+ *   launcher -> worker: a byte, once the worker is allowed to trace it
+ *   worker -> launcher: 0 once it is being traced, or -errno
+ * The worker never waits for the launcher's byte, since its tracees would
+ * be stuck until it arrived. Launchers stay pending, and their connections
+ * wake the tracing loop with the same signal once there's something to
+ * read.
+ *
+ * Launchers have to be in the same user and pid namespaces as the
+ * supervisor, and are refused with EXDEV otherwise. The ids and pids they
+ * use would mean something else to us, and we don't translate them
+ * (through /proc/<pid>/uid_map and NSpid), so a rootless container that
+ * has namespaces of its own has to run its own remainroot instead.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "shims.h"
+#include "daemon.h"
+#include "wait.h"
+
+/* The signal that tells a worker there are launchers waiting. */
+#define DAEMON_SIGNAL SIGRTMIN
+
+volatile sig_atomic_t daemon_pending;
+
+/* In a worker, its end of the socketpair with the supervisor. */
+static int channel = -1;
+
+/* A launcher that has been sent our pid, and hasn't said it's ready yet. */
+struct launcher_t {
+	int conn;
+	pid_t pid;
+	time_t deadline;
+};
+
+static struct launcher_t *launchers;
+static size_t nlaunchers, launchers_max;
+
+static void daemon_signal(int sig)
+{
+	daemon_pending = 1;
+	wait_pending = 1;
+}
+
+static void daemon_address(struct sockaddr_un *addr, const char *path)
+{
+	*addr = (struct sockaddr_un) { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr->sun_path))
+		die("daemon socket path too long: %s", path);
+	strcpy(addr->sun_path, path);
+}
+
+/* Makes fd non-blocking, and has it send us DAEMON_SIGNAL once it can be read. */
+static int daemon_async(int fd)
+{
+	if (fcntl(fd, F_SETOWN, getpid()) < 0 || fcntl(fd, F_SETSIG, DAEMON_SIGNAL) < 0)
+		return -1;
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK | O_ASYNC);
+}
+
+/* Starts a worker, returning the supervisor's end of its channel. */
+static int daemon_worker(int sock, int *channels, unsigned int n, void (*serve)(void))
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+		die("couldn't create worker channel: %m");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("couldn't fork worker: %m");
+	if (pid) {
+		close(fds[1]);
+		return fds[0];
+	}
+
+	/* Otherwise we wouldn't notice the supervisor going away. */
+	close(sock);
+	close(fds[0]);
+	for (unsigned int i = 0; i < n; i++)
+		close(channels[i]);
+	channel = fds[1];
+
+	/* No SA_RESTART, so that the tracing loop notices. */
+	struct sigaction sa = {
+		.sa_handler = daemon_signal,
+	};
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(DAEMON_SIGNAL, &sa, NULL) < 0 || daemon_async(channel) < 0)
+		die("couldn't set up worker: %m");
+	wait_signal(DAEMON_SIGNAL);
+
+	serve();
+	die("should never be reached");
+}
+
+/* Passes a launcher's connection (and pid) on to a worker. */
+static int daemon_handoff(int channel, int conn, pid_t pid)
+{
+	char control[CMSG_SPACE(sizeof(int))] = {0};
+	struct iovec iov = {
+		.iov_base = &pid,
+		.iov_len = sizeof(pid),
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &conn, sizeof(int));
+
+	return sendmsg(channel, &msg, MSG_NOSIGNAL);
+}
+
+void daemon_init(const char *path, unsigned int workers, void (*serve)(void))
+{
+	struct sockaddr_un addr;
+	daemon_address(&addr, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("couldn't create daemon socket: %m");
+	unlink(path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, 128) < 0)
+		die("couldn't listen on %s: %m", path);
+
+	int *channels = calloc(workers, sizeof(int));
+	if (!channels)
+		die("daemon_init: out of memory");
+	for (unsigned int i = 0; i < workers; i++)
+		channels[i] = daemon_worker(sock, channels, i, serve);
+
+	/* Only now, since workers have to be able to wait for their tracees. */
+	signal(SIGCHLD, SIG_IGN);
+
+	for (unsigned int next = 0;;) {
+		int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			die("accept failed: %m");
+		}
+
+		/* Anyone else couldn't be traced by us anyway. */
+		struct ucred peer;
+		socklen_t len = sizeof(peer);
+		if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &len) < 0 || peer.uid != geteuid()) {
+			close(conn);
+			continue;
+		}
+
+		unsigned int tries;
+		for (tries = 0; tries < workers; tries++, next = (next + 1) % workers) {
+			if (channels[next] < 0)
+				continue;
+			if (daemon_handoff(channels[next], conn, peer.pid) >= 0)
+				break;
+			warn("worker %u is gone: %m", next);
+			close(channels[next]);
+			channels[next] = -1;
+		}
+		if (tries == workers)
+			die("no workers left");
+
+		next = (next + 1) % workers;
+		close(conn);
+	}
+}
+
+/*
+ * A launcher that never answers only costs us its connection, but there's
+ * no point keeping that forever (its own CONNECT_TIMEOUT will have run out).
+ * This is only checked when something else wakes us up.
+ */
+#define HANDSHAKE_TIMEOUT 10
+
+static time_t daemon_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Starts the handshake with a new launcher, which is then pending. */
+static void daemon_greet(int conn, pid_t pid)
+{
+	pid_t self = getpid();
+
+	if (daemon_async(conn) < 0 || send(conn, &self, sizeof(self), MSG_NOSIGNAL) != sizeof(self)) {
+		warn("handshake with launcher %d failed: %m", pid);
+		close(conn);
+		return;
+	}
+
+	if (nlaunchers == launchers_max) {
+		size_t max = launchers_max ? launchers_max * 2 : 16;
+		struct launcher_t *new = realloc(launchers, max * sizeof(*new));
+		if (!new)
+			die("daemon_greet: out of memory");
+		launchers = new;
+		launchers_max = max;
+	}
+	launchers[nlaunchers++] = (struct launcher_t) {
+		.conn = conn,
+		.pid = pid,
+		.deadline = daemon_now() + HANDSHAKE_TIMEOUT,
+	};
+}
+
+/* Finishes the handshake with launcher if it's ready, returning whether it's done with. */
+static bool daemon_handshake(struct launcher_t *launcher, int (*attach)(pid_t pid))
+{
+	char ready;
+
+	ssize_t n = recv(launcher->conn, &ready, sizeof(ready), 0);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+		if (daemon_now() < launcher->deadline)
+			return false;
+		warn("launcher %d didn't finish its handshake", launcher->pid);
+		return true;
+	}
+	if (n != sizeof(ready))
+		goto error;
+
+	int err = attach(launcher->pid);
+	if (send(launcher->conn, &err, sizeof(err), MSG_NOSIGNAL) != sizeof(err))
+		goto error;
+	return true;
+
+error:
+	warn("handshake with launcher %d failed", launcher->pid);
+	return true;
+}
+
+void daemon_accept(int (*attach)(pid_t pid))
+{
+	daemon_pending = 0;
+
+	while (channel >= 0) {
+		char control[CMSG_SPACE(sizeof(int))];
+		pid_t pid;
+		struct iovec iov = {
+			.iov_base = &pid,
+			.iov_len = sizeof(pid),
+		};
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+
+		ssize_t n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			break;
+		if (n <= 0) {
+			/* The supervisor is gone, finish what we have and exit. */
+			close(channel);
+			channel = -1;
+			break;
+		}
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (n != sizeof(pid) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		int conn;
+		memcpy(&conn, CMSG_DATA(cmsg), sizeof(int));
+		daemon_greet(conn, pid);
+	}
+
+	for (size_t i = 0; i < nlaunchers;) {
+		if (!daemon_handshake(&launchers[i], attach)) {
+			i++;
+			continue;
+		}
+		close(launchers[i].conn);
+		launchers[i] = launchers[--nlaunchers];
+	}
+}
+
+void daemon_idle(void)
+{
+	if (channel < 0 && !nlaunchers)
+		exit(0);
+	wait_idle();
+}
+
+/* How long a launcher waits for a (possibly busy) worker to get to it. */
+#define CONNECT_TIMEOUT 10
+
+/* Receives exactly len bytes from sock, dying if the supervisor doesn't send them. */
+static void daemon_recv(int sock, void *buf, size_t len, const char *path)
+{
+	ssize_t n;
+
+	do
+		n = recv(sock, buf, len, MSG_WAITALL);
+	while (n < 0 && errno == EINTR);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		die("supervisor at %s didn't answer within %d seconds", path, CONNECT_TIMEOUT);
+	if (n != (ssize_t) len)
+		die("supervisor at %s hung up", path);
+}
+
+void daemon_connect(const char *path)
+{
+	struct timeval timeout = { .tv_sec = CONNECT_TIMEOUT };
+	struct sockaddr_un addr;
+	pid_t worker;
+	char ready = 0;
+	int err;
+
+	daemon_address(&addr, path);
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("couldn't create socket: %m");
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("couldn't connect to %s: %m", path);
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+		die("couldn't set timeout: %m");
+
+	daemon_recv(sock, &worker, sizeof(worker), path);
+
+	/*
+	 * With Yama, only our ancestors could trace us otherwise. Without
+	 * Yama this fails with EINVAL, and there's nothing to do.
+	 */
+	if (prctl(PR_SET_PTRACER, worker, 0, 0, 0) < 0 && errno != EINVAL)
+		die("couldn't let the supervisor trace us: %m");
+
+	if (send(sock, &ready, sizeof(ready), MSG_NOSIGNAL) != sizeof(ready))
+		die("supervisor at %s hung up", path);
+	daemon_recv(sock, &err, sizeof(err), path);
+	if (err == -EXDEV)
+		die("supervisor at %s is in another user or pid namespace, and can't trace us", path);
+	if (err < 0)
+		die("supervisor couldn't trace us: %s", strerror(-err));
+	close(sock);
+
+	char tracer[16];
+	snprintf(tracer, sizeof(tracer), "%d", worker);
+	setenv(SUPERVISOR_ENV, tracer, 1);
+}
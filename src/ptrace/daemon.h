@@ -0,0 +1,58 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if !defined(PTRACE_DAEMON_H)
+#define PTRACE_DAEMON_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Runs the supervisor, listening on the unix socket at path and handing
+ * each launcher that connects to one of workers processes. Each worker
+ * runs serve, which has to trace whatever it's handed (see daemon_accept)
+ * and never returns. Neither does this.
+ */
+void daemon_init(const char *path, unsigned int workers, void (*serve)(void));
+
+/*
+ * In a worker, set (from a signal handler) when there are launchers
+ * waiting, or one of them has answered. The tracing loop should then call
+ * daemon_accept, which never blocks, and calls attach with the pid of each
+ * launcher that is ready. attach returns 0 once the launcher is being
+ * traced, or -errno.
+ */
+extern volatile sig_atomic_t daemon_pending;
+void daemon_accept(int (*attach)(pid_t pid));
+
+/*
+ * Blocks a worker that isn't tracing anything until there's something
+ * for the tracing loop to do (see wait_idle). If the supervisor has gone
+ * away, the worker exits instead.
+ */
+void daemon_idle(void);
+
+/*
+ * The launcher side: asks the supervisor at path to trace us, returning
+ * once it is. The caller should then execve(2) the program.
+ */
+void daemon_connect(const char *path);
+
+#endif /* !defined(PTRACE_DAEMON_H) */
@@ -18,12 +18,32 @@
 
 /* generic-shims.c implements shims using the generic.h API. */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/openat2.h>
 #include "core/proc.h"
 #include "core/cred.h"
+#include "core/file.h"
+#include "core/procfs.h"
+#include "core/rlimit.h"
 #include "generic.h"
 #include "generic-shims.h"
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN3(a, b, c) MIN(MIN(a, b), c)
+#define MAX3(a, b, c) MAX(MAX(a, b), c)
+
 /* SYSCALL1(int, setuid, uid_t, uid) */
 int ptrace_rr_setuid(struct proc_t *current, pid_t pid, uintptr_t *ret)
 {
@@ -76,9 +96,12 @@ int ptrace_rr_getresuid(struct proc_t *current, pid_t pid, uintptr_t *ret)
 	uintptr_t p_euid = ptrace_argument(pid, 1);
 	uintptr_t p_suid = ptrace_argument(pid, 2);
 
-	ptrace_assign_data(pid, p_ruid, ruid);
-	ptrace_assign_data(pid, p_euid, euid);
-	ptrace_assign_data(pid, p_suid, suid);
+	ptrace_write_data(pid, p_ruid, &ruid, sizeof(ruid));
+	ptrace_write_data(pid, p_euid, &euid, sizeof(euid));
+	ptrace_write_data(pid, p_suid, &suid, sizeof(suid));
+
+	/* Otherwise the kernel would fill in the real ids afterwards. */
+	ptrace_skip_syscall(pid);
 	return 0;
 }
 
@@ -141,9 +164,12 @@ int ptrace_rr_getresgid(struct proc_t *current, pid_t pid, uintptr_t *ret)
 	uintptr_t p_egid = ptrace_argument(pid, 1);
 	uintptr_t p_sgid = ptrace_argument(pid, 2);
 
-	ptrace_assign_data(pid, p_rgid, rgid);
-	ptrace_assign_data(pid, p_egid, egid);
-	ptrace_assign_data(pid, p_sgid, sgid);
+	ptrace_write_data(pid, p_rgid, &rgid, sizeof(rgid));
+	ptrace_write_data(pid, p_egid, &egid, sizeof(egid));
+	ptrace_write_data(pid, p_sgid, &sgid, sizeof(sgid));
+
+	/* Otherwise the kernel would fill in the real ids afterwards. */
+	ptrace_skip_syscall(pid);
 	return 0;
 }
 
@@ -157,12 +183,19 @@ int ptrace_rr_getegid(struct proc_t *current, pid_t pid, uintptr_t *ret)
 /* SYSCALL2(int, setgroups, int, size, const gid_t *, list) */
 int ptrace_rr_setgroups(struct proc_t *current, pid_t pid, uintptr_t *ret)
 {
+	static gid_t list[NGROUPS_MAX];
 	int size = ptrace_argument(pid, 0);
 	uintptr_t head = ptrace_argument(pid, 1);
-	gid_t list[NGROUPS_MAX] = {0};
 
-	for (int i = 0; i < size; i++)
-		list[i] = ptrace_deref_data(pid, (uintptr_t) ((gid_t *) head) + i);
+	if (size < 0 || size > NGROUPS_MAX) {
+		*ret = -EINVAL;
+		return 0;
+	}
+
+	if (size && ptrace_read_data(pid, head, list, size * sizeof(gid_t)) < 0) {
+		*ret = -EFAULT;
+		return 0;
+	}
 
 	*ret = __rr_do_setgroups(&current->cred, size, list);
 	return 0;
@@ -171,13 +204,1132 @@ int ptrace_rr_setgroups(struct proc_t *current, pid_t pid, uintptr_t *ret)
 /* SYSCALL2(int, getgroups, int, size, gid_t *, list) */
 int ptrace_rr_getgroups(struct proc_t *current, pid_t pid, uintptr_t *ret)
 {
+	static gid_t list[NGROUPS_MAX];
 	int size = ptrace_argument(pid, 0);
 	uintptr_t head = ptrace_argument(pid, 1);
-	gid_t list[NGROUPS_MAX] = {0};
 
-	*ret = __rr_do_getgroups(&current->cred, size, list);
-	for (int i = 0; i < size; i++)
-		ptrace_assign_data(pid, (uintptr_t) ((gid_t *) head) + i, list[i]);
+	int n = __rr_do_getgroups(&current->cred, size, list);
+	if (n > 0 && size && ptrace_write_data(pid, head, list, n * sizeof(gid_t)) < 0)
+		n = -EFAULT;
+
+	/* Otherwise the kernel would fill in the real groups afterwards. */
+	ptrace_skip_syscall(pid);
+
+	*ret = n;
+	return 0;
+}
+
+/* SYSCALL2(int, capget, cap_user_header_t, header, cap_user_data_t, data) */
+int ptrace_rr_capget(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {0};
+	uintptr_t p_header = ptrace_argument(pid, 0);
+	uintptr_t p_data = ptrace_argument(pid, 1);
+
+	if (ptrace_read_data(pid, p_header, &header, sizeof(header)) < 0) {
+		*ret = -EFAULT;
+		return 0;
+	}
+
+	/* Other processes are fine, as long as they're ours. */
+	struct proc_t *target = current;
+	if (header.pid && header.pid != pid) {
+		target = ptrace_proc(header.pid);
+		if (!target)
+			return SHIM_PASS;
+	}
+
+	/* Unknown versions get the preferred one written back, even without data. */
+	uint32_t version = header.version;
+	*ret = __rr_do_capget(&target->cred, &header, p_data ? data : NULL);
+	if (header.version != version)
+		ptrace_write_data(pid, p_header, &header.version, sizeof(header.version));
+	else if (!*ret && p_data)
+		ptrace_write_data(pid, p_data, data, sizeof(data[0]) *
+		                  (header.version == _LINUX_CAPABILITY_VERSION_1 ? 1 : 2));
+
+	/* Otherwise the kernel would fill in the real capabilities afterwards. */
+	ptrace_skip_syscall(pid);
+	return 0;
+}
+
+/* SYSCALL2(int, capset, cap_user_header_t, header, const cap_user_data_t, data) */
+int ptrace_rr_capset(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {0};
+	uintptr_t p_header = ptrace_argument(pid, 0);
+	uintptr_t p_data = ptrace_argument(pid, 1);
+
+	if (ptrace_read_data(pid, p_header, &header, sizeof(header)) < 0) {
+		*ret = -EFAULT;
+		return 0;
+	}
+
+	/* The pid is relative to the tracee, not us. */
+	if (header.pid == pid)
+		header.pid = 0;
+
+	size_t len = sizeof(data[0]) * (header.version == _LINUX_CAPABILITY_VERSION_1 ? 1 : 2);
+	if (ptrace_read_data(pid, p_data, data, len) < 0) {
+		*ret = -EFAULT;
+		return 0;
+	}
+
+	uint32_t version = header.version;
+	*ret = __rr_do_capset(&current->cred, &header, data);
+	if (header.version != version)
+		ptrace_write_data(pid, p_header, &header.version, sizeof(header.version));
+	return 0;
+}
+
+/* SYSCALL3(int, chown, const char *, path, uid_t, owner, gid_t, group) */
+int ptrace_rr_chown(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	uid_t owner = ptrace_argument(pid, 1);
+	gid_t group = ptrace_argument(pid, 2);
+
+	int err = ptrace_resolve_path(pid, AT_FDCWD, ptrace_argument(pid, 0), false, path, sizeof(path));
+	*ret = err < 0 ? err : __rr_do_chown(&current->cred, path, owner, group);
+	return 0;
+}
+
+/* SYSCALL3(int, fchown, int, fd, uid_t, owner, gid_t, group) */
+int ptrace_rr_fchown(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	int fd = ptrace_argument(pid, 0);
+	uid_t owner = ptrace_argument(pid, 1);
+	gid_t group = ptrace_argument(pid, 2);
+
+	/* The tracee's fd isn't ours, so go through its magic link. */
+	snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, fd);
+	*ret = __rr_do_chown(&current->cred, path, owner, group);
+	return 0;
+}
+
+/* SYSCALL3(int, lchown, const char *, path, uid_t, owner, gid_t, group) */
+int ptrace_rr_lchown(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	uid_t owner = ptrace_argument(pid, 1);
+	gid_t group = ptrace_argument(pid, 2);
+
+	int err = ptrace_resolve_path(pid, AT_FDCWD, ptrace_argument(pid, 0), false, path, sizeof(path));
+	*ret = err < 0 ? err : __rr_do_lchown(&current->cred, path, owner, group);
+	return 0;
+}
+
+/* SYSCALL5(int, fchownat, int, dirfd, const char *, path, uid_t, owner, gid_t, group, int, flags) */
+int ptrace_rr_fchownat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	int dirfd = ptrace_argument(pid, 0);
+	uid_t owner = ptrace_argument(pid, 2);
+	gid_t group = ptrace_argument(pid, 3);
+	int flags = ptrace_argument(pid, 4);
+
+	int err = ptrace_resolve_path(pid, dirfd, ptrace_argument(pid, 1), flags & AT_EMPTY_PATH, path, sizeof(path));
+	if (err < 0) {
+		*ret = err;
+		return 0;
+	}
+
+	/* If we're referring to dirfd, we have to follow the magic link. */
+	if (err > 0)
+		flags &= ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH);
+
+	*ret = __rr_do_fchownat(&current->cred, AT_FDCWD, path, owner, group, flags);
+	return 0;
+}
+
+/* SYSCALL2(int, access, const char *, path, int, mode) */
+int ptrace_rr_access(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	int mode = ptrace_argument(pid, 1);
+
+	int err = ptrace_resolve_path(pid, AT_FDCWD, ptrace_argument(pid, 0), false, path, sizeof(path));
+	*ret = err < 0 ? err : __rr_do_access(&current->cred, path, mode);
+	return 0;
+}
+
+/* SYSCALL3(int, faccessat, int, dirfd, const char *, path, int, mode) */
+int ptrace_rr_faccessat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	int dirfd = ptrace_argument(pid, 0);
+	int mode = ptrace_argument(pid, 2);
+
+	int err = ptrace_resolve_path(pid, dirfd, ptrace_argument(pid, 1), false, path, sizeof(path));
+	*ret = err < 0 ? err : __rr_do_faccessat(&current->cred, AT_FDCWD, path, mode);
+	return 0;
+}
+
+/* SYSCALL4(int, faccessat2, int, dirfd, const char *, path, int, mode, int, flags) */
+int ptrace_rr_faccessat2(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	int dirfd = ptrace_argument(pid, 0);
+	int mode = ptrace_argument(pid, 2);
+	int flags = ptrace_argument(pid, 3);
+
+	int err = ptrace_resolve_path(pid, dirfd, ptrace_argument(pid, 1), flags & AT_EMPTY_PATH, path, sizeof(path));
+	if (err < 0) {
+		*ret = err;
+		return 0;
+	}
+
+	/* If we're referring to dirfd, we have to follow the magic link. */
+	if (err > 0)
+		flags &= ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH);
+
+	*ret = __rr_do_faccessat2(&current->cred, AT_FDCWD, path, mode, flags);
+	return 0;
+}
+
+/*
+ * The observed syscalls. These are all about keeping the faked inode
+ * metadata in file.c in sync with reality, so they're skipped entirely if
+ * nothing is being faked.
+ */
+
+/* Updates the faked mode of {dirfd, path} after a successful chmod. */
+static void sync_chmod(pid_t pid, int dirfd, uintptr_t addr, bool empty_path)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (ptrace_resolve_path(pid, dirfd, addr, empty_path, path, sizeof(path)) < 0)
+		return;
+	if (stat(path, &st) < 0)
+		return;
+
+	file_chmod(st.st_dev, st.st_ino, st.st_mode);
+}
+
+/*
+ * Stashes the inode about to be removed by unlink(2) or rename(2) over it,
+ * so it can be forgotten if the syscall succeeds. Inodes with other links
+ * are still alive afterwards, so they're left alone.
+ */
+static void stash_removal(struct proc_t *current, pid_t pid, int dirfd, uintptr_t addr, bool dir)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	current->syscall.scratch[0] = false;
+
+	if (!file_tracking())
+		return;
+	if (ptrace_resolve_path(pid, dirfd, addr, false, path, sizeof(path)) < 0)
+		return;
+	if (lstat(path, &st) < 0)
+		return;
+	if (!!S_ISDIR(st.st_mode) != dir || (!dir && st.st_nlink > 1))
+		return;
+	if (!file_known(st.st_dev, st.st_ino))
+		return;
+
+	current->syscall.scratch[0] = true;
+	current->syscall.scratch[1] = st.st_dev;
+	current->syscall.scratch[2] = st.st_ino;
+}
+
+static int forget_removal(struct proc_t *current, uintptr_t *ret)
+{
+	if (current->syscall.scratch[0] && !*ret)
+		file_forget(current->syscall.scratch[1], current->syscall.scratch[2]);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_chmod(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+int ptrace_rr_chmod_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	if (!*ret && file_tracking())
+		sync_chmod(pid, AT_FDCWD, ptrace_argument(pid, 0), false);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_fchmod(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+int ptrace_rr_fchmod_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (*ret || !file_tracking())
+		return SHIM_PASS;
+
+	snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, (int) ptrace_argument(pid, 0));
+	if (!stat(path, &st))
+		file_chmod(st.st_dev, st.st_ino, st.st_mode);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_fchmodat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+int ptrace_rr_fchmodat_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	if (!*ret && file_tracking())
+		sync_chmod(pid, ptrace_argument(pid, 0), ptrace_argument(pid, 1), false);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_unlink(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	stash_removal(current, pid, AT_FDCWD, ptrace_argument(pid, 0), false);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_unlink_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+int ptrace_rr_unlinkat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	int dirfd = ptrace_argument(pid, 0);
+	int flags = ptrace_argument(pid, 2);
+
+	stash_removal(current, pid, dirfd, ptrace_argument(pid, 1), flags & AT_REMOVEDIR);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_unlinkat_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+int ptrace_rr_rmdir(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	stash_removal(current, pid, AT_FDCWD, ptrace_argument(pid, 0), true);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_rmdir_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+/* Renaming over an existing file removes it, unless it's a no-op. */
+static void stash_rename(struct proc_t *current, pid_t pid, int olddirfd, uintptr_t oldpath,
+                         int newdirfd, uintptr_t newpath)
+{
+	char path[PATH_MAX];
+	struct stat old, new;
+
+	current->syscall.scratch[0] = false;
+
+	if (!file_tracking())
+		return;
+	if (ptrace_resolve_path(pid, newdirfd, newpath, false, path, sizeof(path)) < 0)
+		return;
+	if (lstat(path, &new) < 0)
+		return;
+
+	if (ptrace_resolve_path(pid, olddirfd, oldpath, false, path, sizeof(path)) < 0)
+		return;
+	if (lstat(path, &old) < 0)
+		return;
+	if (old.st_dev == new.st_dev && old.st_ino == new.st_ino)
+		return;
+
+	stash_removal(current, pid, newdirfd, newpath, S_ISDIR(new.st_mode));
+}
+
+int ptrace_rr_rename(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	stash_rename(current, pid, AT_FDCWD, ptrace_argument(pid, 0), AT_FDCWD, ptrace_argument(pid, 1));
+	return SHIM_PASS;
+}
+
+int ptrace_rr_rename_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+int ptrace_rr_renameat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	stash_rename(current, pid, ptrace_argument(pid, 0), ptrace_argument(pid, 1),
+	             ptrace_argument(pid, 2), ptrace_argument(pid, 3));
+	return SHIM_PASS;
+}
+
+int ptrace_rr_renameat_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+int ptrace_rr_renameat2(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	unsigned int flags = ptrace_argument(pid, 4);
+
+	/* RENAME_EXCHANGE doesn't remove anything. */
+	current->syscall.scratch[0] = false;
+	if (!(flags & RENAME_EXCHANGE))
+		stash_rename(current, pid, ptrace_argument(pid, 0), ptrace_argument(pid, 1),
+		             ptrace_argument(pid, 2), ptrace_argument(pid, 3));
+	return SHIM_PASS;
+}
+
+int ptrace_rr_renameat2_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return forget_removal(current, ret);
+}
+
+/*
+ * Creating device nodes requires CAP_MKNOD in the initial user namespace,
+ * so we create a regular file of the same name instead and fake the rest
+ * with file_mknod. Nothing can be done about opening the "device" though.
+ * The original mode and rdev are kept in scratch so that the tracee's
+ * registers can be restored on exit.
+ */
+static void fake_mknod(struct proc_t *current, pid_t pid, int arg)
+{
+	mode_t mode = ptrace_argument(pid, arg);
+	dev_t rdev = ptrace_argument(pid, arg + 1);
+
+	current->syscall.scratch[0] = false;
+	if (!file_fake_mknod(&current->cred, mode))
+		return;
+
+	if (ptrace_set_argument(pid, arg, S_IFREG | (mode & 07777)) < 0 ||
+	    ptrace_set_argument(pid, arg + 1, 0) < 0)
+		return;
+
+	current->syscall.scratch[0] = true;
+	current->syscall.scratch[1] = mode;
+	current->syscall.scratch[2] = rdev;
+}
+
+static int finish_mknod(struct proc_t *current, pid_t pid, int dirfd, int arg, uintptr_t *ret)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (!current->syscall.scratch[0])
+		return SHIM_PASS;
+
+	mode_t mode = current->syscall.scratch[1];
+	dev_t rdev = current->syscall.scratch[2];
+	ptrace_set_argument(pid, arg, mode);
+	ptrace_set_argument(pid, arg + 1, rdev);
+
+	if (*ret)
+		return SHIM_PASS;
+	if (ptrace_resolve_path(pid, dirfd, ptrace_argument(pid, arg - 1), false, path, sizeof(path)) < 0)
+		return SHIM_PASS;
+	if (lstat(path, &st) < 0)
+		return SHIM_PASS;
+
+	/* The permissions are whatever the umask left. */
+	file_mknod(st.st_dev, st.st_ino, (mode & S_IFMT) | (st.st_mode & 07777), rdev);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_mknod(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	fake_mknod(current, pid, 1);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_mknod_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return finish_mknod(current, pid, AT_FDCWD, 1, ret);
+}
+
+int ptrace_rr_mknodat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	fake_mknod(current, pid, 2);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_mknodat_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return finish_mknod(current, pid, ptrace_argument(pid, 0), 2, ret);
+}
+
+/*
+ * Reading /proc/<pid>/status (and the id maps) would give away the real
+ * credentials. There's no way to hand the tracee a file descriptor, so
+ * instead procfs.c renders the fake contents into a memfd and the path
+ * argument is swapped (by writing a new path to the tracee's stack) for
+ * the memfd's magic link in our /proc/<pid>/fd. Only the path is read for
+ * every other open(2), which is about as cheap as interception gets.
+ *
+ * That link is only reachable if the tracee sees the same / and pids as us
+ * and is allowed to follow magic links. Otherwise the open(2) would fail
+ * outright, so the real file is opened instead.
+ *
+ * XXX: Paths relative to a directory in /proc aren't caught.
+ */
+static void fake_procfs_open(struct proc_t *current, pid_t pid, int arg, int flags)
+{
+	char path[PATH_MAX], memfd_path[64];
+	pid_t target;
+
+	current->syscall.scratch[0] = 0;
+
+	/* Writes should go to the real file (and fail there). */
+	if ((flags & O_ACCMODE) != O_RDONLY)
+		return;
 
+	uintptr_t addr = ptrace_argument(pid, arg);
+	if (ptrace_read_string(pid, addr, path, sizeof(path)) < 0)
+		return;
+
+	enum procfs_file file = procfs_parse(path, pid, &target);
+	if (file == PROCFS_NONE)
+		return;
+
+	struct proc_t *proc = target == pid ? current : ptrace_proc(target);
+	if (!proc)
+		return;
+	if (!ptrace_same_root(pid) || !ptrace_same_ns(pid, "pid"))
+		return;
+
+	int fd = procfs_render(file, target, &proc->cred);
+	if (fd < 0)
+		return;
+
+	size_t len = snprintf(memfd_path, sizeof(memfd_path), "/proc/%d/fd/%d", getpid(), fd) + 1;
+	uintptr_t scratch = ptrace_stack_scratch(pid, len);
+	if (ptrace_write_data(pid, scratch, memfd_path, len) < 0 ||
+	    ptrace_set_argument(pid, arg, scratch) < 0) {
+		close(fd);
+		return;
+	}
+
+	current->syscall.scratch[0] = fd + 1;
+	current->syscall.scratch[1] = addr;
+}
+
+/* The tracee has its own open file description now, so ours can go. */
+static int finish_procfs_open(struct proc_t *current, pid_t pid, int arg)
+{
+	if (!current->syscall.scratch[0])
+		return SHIM_PASS;
+
+	ptrace_set_argument(pid, arg, current->syscall.scratch[1]);
+	close(current->syscall.scratch[0] - 1);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_open(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	fake_procfs_open(current, pid, 0, ptrace_argument(pid, 1));
+	return SHIM_PASS;
+}
+
+int ptrace_rr_open_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return finish_procfs_open(current, pid, 0);
+}
+
+int ptrace_rr_openat(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	fake_procfs_open(current, pid, 1, ptrace_argument(pid, 2));
+	return SHIM_PASS;
+}
+
+int ptrace_rr_openat_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return finish_procfs_open(current, pid, 1);
+}
+
+int ptrace_rr_openat2(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	struct open_how how;
+
+	current->syscall.scratch[0] = 0;
+	if (ptrace_read_data(pid, ptrace_argument(pid, 2), &how, sizeof(how)) < 0)
+		return SHIM_PASS;
+
+	/* Any of these would stop the tracee from following our magic link. */
+	if (how.resolve)
+		return SHIM_PASS;
+
+	fake_procfs_open(current, pid, 1, how.flags);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_openat2_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return finish_procfs_open(current, pid, 1);
+}
+
+/*
+ * prctl(2) does far too much to emulate, so only some options are. Every
+ * other option (PR_SET_NAME, PR_SET_PDEATHSIG and friends) is filtered out
+ * by looking at a single register.
+ */
+int ptrace_rr_prctl(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	int option = ptrace_argument(pid, 0);
+
+	if (!cred_prctl_option(option))
+		return SHIM_PASS;
+
+	*ret = cred_prctl(&current->cred, option, ptrace_argument(pid, 1), ptrace_argument(pid, 2),
+	                  ptrace_argument(pid, 3), ptrace_argument(pid, 4));
+	return SHIM_EMULATE;
+}
+
+int ptrace_rr_prctl_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+/*
+ * Peer credentials of unix sockets are filled in by the kernel, so they
+ * have the real ids of the peer. If the peer is one of ours, they're
+ * rewritten on the way out with the peer's faked ids. Only the pid is
+ * trusted, which is fine since it comes from the kernel.
+ *
+ * XXX: SO_PEERCRED should really have the ids the peer had at connect(2)
+ *      time, rather than the ones it has now. Faked ids sent explicitly
+ *      with SCM_CREDENTIALS will still be rejected by sendmsg(2).
+ */
+
+/* Rewrites a struct ucred in the tracee. euid is whether to use the effective ids. */
+static void fake_ucred(pid_t pid, uintptr_t addr, bool euid)
+{
+	struct ucred ucred;
+
+	if (ptrace_read_data(pid, addr, &ucred, sizeof(ucred)) < 0)
+		return;
+
+	struct proc_t *peer = ptrace_proc(ucred.pid);
+	if (!peer)
+		return;
+
+	ucred.uid = euid ? peer->cred.euid : peer->cred.uid;
+	ucred.gid = euid ? peer->cred.egid : peer->cred.gid;
+	ptrace_write_data(pid, addr, &ucred, sizeof(ucred));
+}
+
+int ptrace_rr_getsockopt(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+int ptrace_rr_getsockopt_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	socklen_t len;
+
+	/* Only the level and option are looked at for everything else. */
+	if (*ret || ptrace_argument(pid, 1) != SOL_SOCKET || ptrace_argument(pid, 2) != SO_PEERCRED)
+		return SHIM_PASS;
+
+	if (ptrace_read_data(pid, ptrace_argument(pid, 4), &len, sizeof(len)) < 0)
+		return SHIM_PASS;
+	if (len >= sizeof(struct ucred))
+		fake_ucred(pid, ptrace_argument(pid, 3), true);
+	return SHIM_PASS;
+}
+
+int ptrace_rr_recvmsg(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return SHIM_PASS;
+}
+
+int ptrace_rr_recvmsg_exit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	static char control[64 * 1024];
+	struct msghdr msg;
+
+	if ((long) *ret < 0)
+		return SHIM_PASS;
+	if (ptrace_read_data(pid, ptrace_argument(pid, 1), &msg, sizeof(msg)) < 0)
+		return SHIM_PASS;
+	if (!msg.msg_control || msg.msg_controllen < CMSG_LEN(sizeof(struct ucred)))
+		return SHIM_PASS;
+
+	/*
+	 * Walk a local copy of the control messages, so the CMSG_* macros work,
+	 * but rewrite the credentials in the tracee.
+	 */
+	uintptr_t remote = (uintptr_t) msg.msg_control;
+	msg.msg_controllen = MIN(msg.msg_controllen, sizeof(control));
+	if (ptrace_read_data(pid, remote, control, msg.msg_controllen) < 0)
+		return SHIM_PASS;
+	msg.msg_control = control;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_CREDENTIALS)
+			continue;
+		if (cmsg->cmsg_len < CMSG_LEN(sizeof(struct ucred)))
+			continue;
+		fake_ucred(pid, remote + ((char *) CMSG_DATA(cmsg) - control), false);
+	}
+	return SHIM_PASS;
+}
+
+/*
+ * The xattr syscalls. Only security.* names are faked, so everything else
+ * is passed through after looking at the name (which is the only cost
+ * user.* xattrs pay). Listing has to merge in the faked names, but that
+ * is skipped unless the inode has any.
+ */
+
+enum xattr_target {
+	XATTR_FOLLOW,
+	XATTR_NOFOLLOW,
+	XATTR_FD,
+};
+
+/* Scratch space for values and lists, which can be far too big for the stack. */
+static char xattr_buf[MAX(XATTR_SIZE_MAX, XATTR_LIST_MAX)];
+static char xattr_names[XATTR_LIST_MAX];
+
+/* Reads the name argument, and checks if it's one we fake. */
+static bool xattr_faked_name(pid_t pid, uintptr_t addr, char *name, size_t len)
+{
+	if (ptrace_read_string(pid, addr, name, len) < 0)
+		return false;
+	return !strncmp(name, FILE_XATTR_PREFIX, strlen(FILE_XATTR_PREFIX));
+}
+
+/* Stats the first argument of any of the xattr syscalls. */
+static int xattr_stat(pid_t pid, enum xattr_target target, struct stat *st)
+{
+	char path[PATH_MAX];
+
+	if (target == XATTR_FD) {
+		snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, (int) ptrace_argument(pid, 0));
+	} else {
+		int err = ptrace_resolve_path(pid, AT_FDCWD, ptrace_argument(pid, 0), false, path, sizeof(path));
+		if (err < 0)
+			return err;
+	}
+
+	if ((target == XATTR_NOFOLLOW ? lstat : stat)(path, st) < 0)
+		return -errno;
 	return 0;
 }
+
+static int xattr_pass(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	return SHIM_PASS;
+}
+
+static int xattr_set(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	char name[XATTR_NAME_MAX + 1];
+	struct stat st;
+
+	if (!xattr_faked_name(pid, ptrace_argument(pid, 1), name, sizeof(name)))
+		return SHIM_PASS;
+
+	uintptr_t value = ptrace_argument(pid, 2);
+	size_t size = ptrace_argument(pid, 3);
+	int flags = ptrace_argument(pid, 4);
+
+	int err = xattr_stat(pid, target, &st);
+	if (err < 0)
+		goto out;
+
+	err = -E2BIG;
+	if (size > XATTR_SIZE_MAX)
+		goto out;
+	err = -EFAULT;
+	if (size && ptrace_read_data(pid, value, xattr_buf, size) < 0)
+		goto out;
+
+	err = file_setxattr(&current->cred, st.st_dev, st.st_ino, name, xattr_buf, size, flags);
+out:
+	/* Otherwise the kernel would really set it, as the real (namespaced) root. */
+	ptrace_skip_syscall(pid);
+	*ret = err;
+	return SHIM_EMULATE;
+}
+
+/* Ownership might be stored in a (user.*) xattr that was just changed. */
+static int xattr_changed(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	char name[XATTR_NAME_MAX + 1];
+	struct stat st;
+
+	if (*ret || !file_tracking())
+		return SHIM_PASS;
+	if (ptrace_read_string(pid, ptrace_argument(pid, 1), name, sizeof(name)) < 0)
+		return SHIM_PASS;
+	if (xattr_stat(pid, target, &st) < 0)
+		return SHIM_PASS;
+
+	file_xattr_changed(st.st_dev, st.st_ino, name);
+	return SHIM_PASS;
+}
+
+static int xattr_get(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	char name[XATTR_NAME_MAX + 1];
+	struct stat st;
+
+	if (!file_tracking())
+		return SHIM_PASS;
+	if (!xattr_faked_name(pid, ptrace_argument(pid, 1), name, sizeof(name)))
+		return SHIM_PASS;
+	if (xattr_stat(pid, target, &st) < 0)
+		return SHIM_PASS;
+
+	uintptr_t value = ptrace_argument(pid, 2);
+	size_t size = MIN(ptrace_argument(pid, 3), XATTR_SIZE_MAX);
+
+	ssize_t n = file_getxattr(st.st_dev, st.st_ino, name, xattr_buf, size);
+	if (n == -ENODATA)
+		return SHIM_PASS;
+	if (n > 0 && size && ptrace_write_data(pid, value, xattr_buf, n) < 0)
+		n = -EFAULT;
+
+	*ret = n;
+	return SHIM_EMULATE;
+}
+
+static int xattr_list(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	struct stat st;
+
+	if ((long) *ret < 0 || !file_tracking())
+		return SHIM_PASS;
+	if (xattr_stat(pid, target, &st) < 0 || !file_xattr_faked(st.st_dev, st.st_ino))
+		return SHIM_PASS;
+
+	uintptr_t list = ptrace_argument(pid, 1);
+	size_t size = ptrace_argument(pid, 2);
+	size_t len = *ret;
+
+	/*
+	 * Just asking for the size. We can't tell which of the faked names
+	 * shadow real ones without reading the list, but overestimating is
+	 * harmless.
+	 */
+	if (!size) {
+		*ret = len + file_listxattr(st.st_dev, st.st_ino, NULL, 0);
+		return SHIM_EMULATE;
+	}
+
+	if (ptrace_read_data(pid, list, xattr_buf, len) < 0)
+		return SHIM_PASS;
+
+	ssize_t n = file_listxattr(st.st_dev, st.st_ino, xattr_names, sizeof(xattr_names));
+	if (n < 0)
+		return SHIM_PASS;
+
+	size_t total = len;
+	for (char *name = xattr_names; name < xattr_names + n; name += strlen(name) + 1) {
+		bool shadowed = false;
+		for (char *real = xattr_buf; real < xattr_buf + len; real += strlen(real) + 1)
+			if (!strcmp(name, real))
+				shadowed = true;
+		if (shadowed)
+			continue;
+
+		size_t name_len = strlen(name) + 1;
+		if (total + name_len > MIN(size, XATTR_LIST_MAX)) {
+			*ret = -ERANGE;
+			return SHIM_EMULATE;
+		}
+		memcpy(xattr_buf + total, name, name_len);
+		total += name_len;
+	}
+
+	if (total != len && ptrace_write_data(pid, list + len, xattr_buf + len, total - len) < 0)
+		total = -EFAULT;
+
+	*ret = total;
+	return SHIM_EMULATE;
+}
+
+static int xattr_remove(struct proc_t *current, pid_t pid, uintptr_t *ret, enum xattr_target target)
+{
+	char name[XATTR_NAME_MAX + 1];
+	struct stat st;
+
+	if (!xattr_faked_name(pid, ptrace_argument(pid, 1), name, sizeof(name)))
+		return SHIM_PASS;
+	if (xattr_stat(pid, target, &st) < 0)
+		return SHIM_PASS;
+
+	/*
+	 * If we didn't fake it, the caller is allowed to remove whatever is
+	 * really there, and the kernel can do that.
+	 */
+	int err = file_removexattr(&current->cred, st.st_dev, st.st_ino, name);
+	if (err == -ENODATA)
+		return SHIM_PASS;
+
+	ptrace_skip_syscall(pid);
+	*ret = err;
+	return SHIM_EMULATE;
+}
+
+#define XATTR_SHIM(func, entry, exit, target) \
+	int ptrace_rr_ ## func(struct proc_t *current, pid_t pid, uintptr_t *ret) \
+	{ \
+		return entry(current, pid, ret, target); \
+	} \
+	\
+	int ptrace_rr_ ## func ## _exit(struct proc_t *current, pid_t pid, uintptr_t *ret) \
+	{ \
+		return exit(current, pid, ret, target); \
+	}
+
+XATTR_SHIM(setxattr, xattr_set, xattr_changed, XATTR_FOLLOW)
+XATTR_SHIM(lsetxattr, xattr_set, xattr_changed, XATTR_NOFOLLOW)
+XATTR_SHIM(fsetxattr, xattr_set, xattr_changed, XATTR_FD)
+XATTR_SHIM(getxattr, xattr_pass, xattr_get, XATTR_FOLLOW)
+XATTR_SHIM(lgetxattr, xattr_pass, xattr_get, XATTR_NOFOLLOW)
+XATTR_SHIM(fgetxattr, xattr_pass, xattr_get, XATTR_FD)
+XATTR_SHIM(listxattr, xattr_pass, xattr_list, XATTR_FOLLOW)
+XATTR_SHIM(llistxattr, xattr_pass, xattr_list, XATTR_NOFOLLOW)
+XATTR_SHIM(flistxattr, xattr_pass, xattr_list, XATTR_FD)
+XATTR_SHIM(removexattr, xattr_remove, xattr_changed, XATTR_FOLLOW)
+XATTR_SHIM(lremovexattr, xattr_remove, xattr_changed, XATTR_NOFOLLOW)
+XATTR_SHIM(fremovexattr, xattr_remove, xattr_changed, XATTR_FD)
+
+/*
+ * The stat(2) family is among the hottest syscalls there are, so the
+ * common case (nothing is faked for this inode) has to be cheap: a single
+ * read of the tracee's buffer and a lookup that usually stops at the
+ * inode table's filter. The faked fields are all next to each other, so
+ * rewriting them is a single write.
+ */
+
+/* The range of a struct covering three of its fields. */
+#define FIELDS_START(type, a, b, c) \
+	MIN3(offsetof(type, a), offsetof(type, b), offsetof(type, c))
+#define FIELD_END(type, f) (offsetof(type, f) + sizeof(((type *) 0)->f))
+#define FIELDS_END(type, a, b, c) \
+	MAX3(FIELD_END(type, a), FIELD_END(type, b), FIELD_END(type, c))
+
+static void fake_owner(struct inode_t *inode, uid_t *uid, gid_t *gid, mode_t *mode, dev_t *rdev)
+{
+	if (inode->flags & INODE_UID)
+		*uid = inode->uid;
+	if (inode->flags & INODE_GID)
+		*gid = inode->gid;
+	if (inode->flags & INODE_MODE)
+		*mode = inode->mode;
+	if (inode->flags & INODE_RDEV)
+		*rdev = inode->rdev;
+}
+
+/*
+ * Which arguments of a stat(2)-family syscall refer to the file (-1 if the
+ * syscall doesn't have one). These are only looked at if the inode's
+ * metadata has to be loaded from the file itself.
+ */
+struct stat_args_t {
+	int dirfd, path, flags, buf;
+	int default_flags;
+};
+
+/* Gets the faked metadata for an inode that was just stat(2)ed. */
+static struct inode_t *stat_lookup(pid_t pid, struct stat_args_t *args, dev_t dev, ino_t ino)
+{
+	char path[PATH_MAX];
+
+	struct inode_t *inode = file_lookup(dev, ino);
+	if (inode || !file_needs_path(dev, ino))
+		return inode;
+
+	int dirfd = args->dirfd < 0 ? AT_FDCWD : (int) ptrace_argument(pid, args->dirfd);
+	int flags = args->flags < 0 ? args->default_flags : (int) ptrace_argument(pid, args->flags);
+	bool follow = !(flags & AT_SYMLINK_NOFOLLOW);
+
+	if (args->path < 0) {
+		snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, dirfd);
+		follow = true;
+	} else {
+		int err = ptrace_resolve_path(pid, dirfd, ptrace_argument(pid, args->path),
+		                              flags & AT_EMPTY_PATH, path, sizeof(path));
+		if (err < 0)
+			return NULL;
+		if (err > 0)
+			follow = true;
+	}
+
+	return file_load(dev, ino, path, follow);
+}
+
+static int fixup_stat(pid_t pid, struct stat_args_t *args)
+{
+	struct stat st;
+	uintptr_t addr = ptrace_argument(pid, args->buf);
+
+	const size_t start = FIELDS_START(struct stat, st_uid, st_gid, st_mode);
+	const size_t end = MAX3(FIELDS_END(struct stat, st_uid, st_gid, st_mode),
+	                        FIELD_END(struct stat, st_dev), FIELD_END(struct stat, st_rdev));
+
+	if (ptrace_read_data(pid, addr, &st, end) < 0)
+		return SHIM_PASS;
+
+	struct inode_t *inode = stat_lookup(pid, args, st.st_dev, st.st_ino);
+	if (!inode)
+		return SHIM_PASS;
+
+	uid_t uid = st.st_uid;
+	gid_t gid = st.st_gid;
+	mode_t mode = st.st_mode;
+	fake_owner(inode, &uid, &gid, &mode, &st.st_rdev);
+	st.st_uid = uid;
+	st.st_gid = gid;
+	st.st_mode = mode;
+
+	/* st_rdev comes right after st_gid, so device nodes are still one write. */
+	size_t wend = FIELDS_END(struct stat, st_uid, st_gid, st_mode);
+	if (inode->flags & INODE_RDEV)
+		wend = MAX(wend, FIELD_END(struct stat, st_rdev));
+	ptrace_write_data(pid, addr + start, (char *) &st + start, wend - start);
+	return SHIM_PASS;
+}
+
+static int fixup_statx(pid_t pid, struct stat_args_t *args)
+{
+	struct statx stx;
+	uintptr_t addr = ptrace_argument(pid, args->buf);
+
+	const size_t start = FIELDS_START(struct statx, stx_uid, stx_gid, stx_mode);
+	const size_t end = MAX(FIELDS_END(struct statx, stx_uid, stx_gid, stx_mode),
+	                       FIELDS_END(struct statx, stx_ino, stx_dev_major, stx_dev_minor));
+
+	if (ptrace_read_data(pid, addr, &stx, end) < 0)
+		return SHIM_PASS;
+
+	dev_t dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	struct inode_t *inode = stat_lookup(pid, args, dev, stx.stx_ino);
+	if (!inode)
+		return SHIM_PASS;
+
+	uid_t uid = stx.stx_uid;
+	gid_t gid = stx.stx_gid;
+	mode_t mode = stx.stx_mode;
+	dev_t rdev = 0;
+	fake_owner(inode, &uid, &gid, &mode, &rdev);
+	stx.stx_uid = uid;
+	stx.stx_gid = gid;
+	stx.stx_mode = mode;
+
+	const size_t wend = FIELDS_END(struct statx, stx_uid, stx_gid, stx_mode);
+	ptrace_write_data(pid, addr + start, (char *) &stx + start, wend - start);
+
+	/* Unlike struct stat, the device number is nowhere near the owner. */
+	if (inode->flags & INODE_RDEV) {
+		stx.stx_rdev_major = major(rdev);
+		stx.stx_rdev_minor = minor(rdev);
+
+		const size_t rstart = offsetof(struct statx, stx_rdev_major);
+		const size_t rend = FIELD_END(struct statx, stx_rdev_minor);
+		ptrace_write_data(pid, addr + rstart, (char *) &stx + rstart, rend - rstart);
+	}
+	return SHIM_PASS;
+}
+
+#define STAT_SHIM(func, fixup, ...) \
+	int ptrace_rr_ ## func(struct proc_t *current, pid_t pid, uintptr_t *ret) \
+	{ \
+		return SHIM_PASS; \
+	} \
+	\
+	int ptrace_rr_ ## func ## _exit(struct proc_t *current, pid_t pid, uintptr_t *ret) \
+	{ \
+		struct stat_args_t args = { __VA_ARGS__ }; \
+		if (*ret || !file_tracking()) \
+			return SHIM_PASS; \
+		return fixup(pid, &args); \
+	}
+
+STAT_SHIM(stat, fixup_stat, .dirfd = -1, .path = 0, .flags = -1, .buf = 1)
+STAT_SHIM(lstat, fixup_stat, .dirfd = -1, .path = 0, .flags = -1, .buf = 1,
+          .default_flags = AT_SYMLINK_NOFOLLOW)
+STAT_SHIM(fstat, fixup_stat, .dirfd = 0, .path = -1, .flags = -1, .buf = 1)
+STAT_SHIM(newfstatat, fixup_stat, .dirfd = 0, .path = 1, .flags = 3, .buf = 2)
+STAT_SHIM(statx, fixup_statx, .dirfd = 0, .path = 1, .flags = 2, .buf = 4)
+
+/*
+ * Resource limits. We have the same real uid as every tracee, so we can
+ * change their real limits with prlimit(2) ourselves, which means that
+ * all three syscalls can be emulated outright.
+ */
+static int rlimit_shim(struct proc_t *current, pid_t pid, uintptr_t *ret, pid_t target_pid,
+                       int resource, uintptr_t p_new, uintptr_t p_old)
+{
+	struct rlimit real, new, old, apply;
+
+	if (resource < 0 || resource >= RLIM_NLIMITS)
+		return SHIM_PASS;
+
+	struct proc_t *target = current;
+	if (target_pid && target_pid != pid) {
+		target = ptrace_proc(target_pid);
+		if (!target)
+			return SHIM_PASS;
+	} else {
+		target_pid = pid;
+	}
+
+	/* Limits belong to the whole process, not to a thread. */
+	struct rlimit_t *limits = &ptrace_leader(target)->rlimit;
+
+	/* Unless something is faked, reading limits is left to the kernel. */
+	if (!p_new && !rlimit_faked(limits, resource))
+		return SHIM_PASS;
+
+	if (p_new && ptrace_read_data(pid, p_new, &new, sizeof(new)) != sizeof(new)) {
+		*ret = -EFAULT;
+		return SHIM_EMULATE;
+	}
+	if (prlimit(target_pid, resource, NULL, &real) < 0)
+		return SHIM_PASS;
+
+	*ret = rlimit_permission(&current->cred, &target->cred);
+	if (!*ret)
+		*ret = rlimit_set(limits, &current->cred, resource, &real,
+		                  p_new ? &new : NULL, p_old ? &old : NULL, &apply);
+
+	if (!*ret && p_new) {
+		if (apply.rlim_cur != new.rlim_cur || apply.rlim_max != new.rlim_max)
+			rlimit_clamped(target_pid, resource, &new, &apply);
+		if ((apply.rlim_cur != real.rlim_cur || apply.rlim_max != real.rlim_max) &&
+		    prlimit(target_pid, resource, &apply, NULL) < 0)
+			*ret = -errno;
+	}
+	if (!*ret && p_old && ptrace_write_data(pid, p_old, &old, sizeof(old)) != sizeof(old))
+		*ret = -EFAULT;
+
+	ptrace_skip_syscall(pid);
+	return SHIM_EMULATE;
+}
+
+/* SYSCALL2(int, getrlimit, int, resource, struct rlimit *, rlim) */
+int ptrace_rr_getrlimit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return rlimit_shim(current, pid, ret, 0, ptrace_argument(pid, 0), 0, ptrace_argument(pid, 1));
+}
+
+/* SYSCALL2(int, setrlimit, int, resource, const struct rlimit *, rlim) */
+int ptrace_rr_setrlimit(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return rlimit_shim(current, pid, ret, 0, ptrace_argument(pid, 0), ptrace_argument(pid, 1), 0);
+}
+
+/* SYSCALL4(int, prlimit64, pid_t, pid, int, resource, const struct rlimit *, new, struct rlimit *, old) */
+int ptrace_rr_prlimit64(struct proc_t *current, pid_t pid, uintptr_t *ret)
+{
+	return rlimit_shim(current, pid, ret, ptrace_argument(pid, 0), ptrace_argument(pid, 1),
+	                   ptrace_argument(pid, 2), ptrace_argument(pid, 3));
+}
@@ -25,6 +25,24 @@
 #include <sys/types.h>
 #include "core/proc.h"
 
+/*
+ * Shims return one of these on success (and -1 on failure). SHIM_EMULATE
+ * means that the syscall's return value should be replaced with *ret, while
+ * SHIM_PASS means that whatever the kernel returned should be kept.
+ */
+#define SHIM_EMULATE 0
+#define SHIM_PASS    1
+
+/* Looks up another traced process (see ptrace.c), or NULL if it isn't traced. */
+struct proc_t *ptrace_proc(pid_t pid);
+
+/*
+ * Looks up the leader of a traced thread's thread group, which holds the
+ * state that the whole process shares. If the leader isn't traced (or is
+ * already gone), this is the thread itself.
+ */
+struct proc_t *ptrace_leader(struct proc_t *proc);
+
 /* XXX: I think I'm overusing this hack. */
 #define SYSCALL(func) int ptrace_rr_ ## func(struct proc_t *, pid_t, uintptr_t *);
 #define SYSCALL0(type, func, ...) SYSCALL(func)
@@ -37,6 +55,7 @@
 #define LIBCALL0(...)
 #define LIBCALL1 LIBCALL0
 #include "core/cred.h"
+#include "core/file.h"
 #undef SYSCALL
 #undef SYSCALL0
 #undef SYSCALL1
@@ -48,4 +67,65 @@
 #undef LIBCALL0
 #undef LIBCALL1
 
+/*
+ * Syscalls which we don't emulate, but where we need to keep our state in
+ * sync with what the kernel did. ptrace_rr_<func> is run on syscall entry
+ * and ptrace_rr_<func>_exit on syscall exit (with *ret set to the return
+ * value). Both return SHIM_PASS unless they want to change the result.
+ */
+#define OBSERVED_SYSCALLS(OBSERVE) \
+	OBSERVE(chmod) \
+	OBSERVE(fchmod) \
+	OBSERVE(fchmodat) \
+	OBSERVE(unlink) \
+	OBSERVE(unlinkat) \
+	OBSERVE(rmdir) \
+	OBSERVE(rename) \
+	OBSERVE(renameat) \
+	OBSERVE(renameat2) \
+	OBSERVE(mknod) \
+	OBSERVE(mknodat) \
+	OBSERVE(open) \
+	OBSERVE(openat) \
+	OBSERVE(openat2) \
+	OBSERVE(prctl) \
+	OBSERVE(getsockopt) \
+	OBSERVE(recvmsg) \
+	OBSERVE(setxattr) \
+	OBSERVE(lsetxattr) \
+	OBSERVE(fsetxattr) \
+	OBSERVE(getxattr) \
+	OBSERVE(lgetxattr) \
+	OBSERVE(fgetxattr) \
+	OBSERVE(listxattr) \
+	OBSERVE(llistxattr) \
+	OBSERVE(flistxattr) \
+	OBSERVE(removexattr) \
+	OBSERVE(lremovexattr) \
+	OBSERVE(fremovexattr) \
+	OBSERVE(stat) \
+	OBSERVE(lstat) \
+	OBSERVE(fstat) \
+	OBSERVE(newfstatat) \
+	OBSERVE(statx)
+
+#define OBSERVE(func) \
+	int ptrace_rr_ ## func(struct proc_t *, pid_t, uintptr_t *); \
+	int ptrace_rr_ ## func ## _exit(struct proc_t *, pid_t, uintptr_t *);
+OBSERVED_SYSCALLS(OBSERVE)
+#undef OBSERVE
+
+/*
+ * Syscalls which are emulated on entry like the core/ ones, but whose
+ * state lives in the proc_t rather than the cred_t.
+ */
+#define PROC_SYSCALLS(SHIM) \
+	SHIM(getrlimit) \
+	SHIM(setrlimit) \
+	SHIM(prlimit64)
+
+#define SHIM(func) int ptrace_rr_ ## func(struct proc_t *, pid_t, uintptr_t *);
+PROC_SYSCALLS(SHIM)
+#undef SHIM
+
 #endif /* !defined(PTRACE_GENERIC_SHIMS_H) */
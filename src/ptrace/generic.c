@@ -0,0 +1,175 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* ptrace/generic.c implements the architecture-independent parts of generic.h. */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ptrace.h>
+
+#include "generic.h"
+
+#define PAGE_MASK(addr) ((addr) & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1))
+
+ssize_t ptrace_read_data(pid_t pid, uintptr_t addr, void *buf, size_t len)
+{
+	struct iovec local = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+	struct iovec remote = {
+		.iov_base = (void *) addr,
+		.iov_len = len,
+	};
+
+	return process_vm_readv(pid, &local, 1, &remote, 1, 0);
+}
+
+ssize_t ptrace_write_data(pid_t pid, uintptr_t addr, const void *buf, size_t len)
+{
+	struct iovec local = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+	struct iovec remote = {
+		.iov_base = (void *) addr,
+		.iov_len = len,
+	};
+
+	ssize_t n = process_vm_writev(pid, &local, 1, &remote, 1, 0);
+	if (n >= 0 || errno != EFAULT)
+		return n;
+
+	/*
+	 * process_vm_writev(2) respects page protections, but PTRACE_POKEDATA
+	 * doesn't. Fall back to writing a word at a time, merging the edges
+	 * with whatever is already there.
+	 */
+	const char *src = buf;
+	for (size_t done = 0; done < len;) {
+		uintptr_t word_addr = (addr + done) & ~(sizeof(long) - 1);
+		size_t offset = (addr + done) - word_addr;
+		size_t chunk = sizeof(long) - offset;
+		if (chunk > len - done)
+			chunk = len - done;
+
+		long word = 0;
+		if (offset || chunk != sizeof(long)) {
+			errno = 0;
+			word = ptrace(PTRACE_PEEKDATA, pid, word_addr, NULL);
+			if (errno)
+				return -1;
+		}
+		memcpy((char *) &word + offset, src + done, chunk);
+		if (ptrace(PTRACE_POKEDATA, pid, word_addr, word) < 0)
+			return -1;
+		done += chunk;
+	}
+	return len;
+}
+
+ssize_t ptrace_read_string(pid_t pid, uintptr_t addr, char *buf, size_t len)
+{
+	size_t done = 0;
+
+	/*
+	 * We don't know how long the string is, and process_vm_readv(2) won't
+	 * do partial reads within an iovec. So read up to each page boundary
+	 * at a time, to avoid faulting on the page after the string.
+	 */
+	while (done < len) {
+		uintptr_t next = PAGE_MASK(addr + done) + sysconf(_SC_PAGESIZE);
+		size_t chunk = next - (addr + done);
+		if (chunk > len - done)
+			chunk = len - done;
+
+		ssize_t n = ptrace_read_data(pid, addr + done, buf + done, chunk);
+		if (n <= 0)
+			return -1;
+
+		char *nul = memchr(buf + done, '\0', n);
+		if (nul)
+			return nul - buf;
+		done += n;
+	}
+
+	errno = ENAMETOOLONG;
+	return -1;
+}
+
+int ptrace_resolve_path(pid_t pid, int dirfd, uintptr_t path, bool empty_path, char *buf, size_t len)
+{
+	char tracee_path[PATH_MAX];
+	int n;
+
+	if (ptrace_read_string(pid, path, tracee_path, sizeof(tracee_path)) < 0)
+		return -errno;
+
+	/*
+	 * Absolute paths are resolved inside the tracee's root, so that we
+	 * still work for chroot(2)ed processes (debootstrap and friends).
+	 */
+	if (tracee_path[0] == '/')
+		n = snprintf(buf, len, "/proc/%d/root%s", pid, tracee_path);
+	else if (tracee_path[0] == '\0' && !empty_path)
+		return -ENOENT;
+	else if (dirfd == AT_FDCWD)
+		n = snprintf(buf, len, "/proc/%d/cwd/%s", pid, tracee_path);
+	else if (tracee_path[0] == '\0')
+		n = snprintf(buf, len, "/proc/%d/fd/%d", pid, dirfd);
+	else
+		n = snprintf(buf, len, "/proc/%d/fd/%d/%s", pid, dirfd, tracee_path);
+
+	if (n < 0 || (size_t) n >= len)
+		return -ENAMETOOLONG;
+	return tracee_path[0] == '\0';
+}
+
+/* Whether both paths exist and refer to the same inode. */
+static bool same_inode(const char *a, const char *b)
+{
+	struct stat sa, sb;
+
+	if (stat(a, &sa) < 0 || stat(b, &sb) < 0)
+		return false;
+	return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+bool ptrace_same_ns(pid_t pid, const char *ns)
+{
+	char theirs[64], ours[64];
+
+	snprintf(theirs, sizeof(theirs), "/proc/%d/ns/%s", pid, ns);
+	snprintf(ours, sizeof(ours), "/proc/self/ns/%s", ns);
+	return same_inode(theirs, ours);
+}
+
+bool ptrace_same_root(pid_t pid)
+{
+	char theirs[64];
+
+	snprintf(theirs, sizeof(theirs), "/proc/%d/root", pid);
+	return same_inode(theirs, "/");
+}
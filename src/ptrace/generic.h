@@ -20,6 +20,7 @@
 #define PTRACE_GENERIC_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 /* Gets the syscall number. */
@@ -29,8 +30,60 @@ long ptrace_syscall(pid_t pid);
 uintptr_t ptrace_argument(pid_t pid, int arg);
 int ptrace_return(pid_t pid, uintptr_t ret);
 
+/*
+ * Changes a syscall argument. Only valid at syscall entry, and the kernel
+ * won't restore it, so the shim has to put it back on exit.
+ */
+int ptrace_set_argument(pid_t pid, int arg, uintptr_t value);
+
+/*
+ * Stops the kernel from running the syscall at all (it fails with ENOSYS
+ * instead, which the shim then replaces). Needed when the kernel would
+ * otherwise overwrite what the shim wrote to the tracee. Only valid at
+ * syscall entry.
+ */
+int ptrace_skip_syscall(pid_t pid);
+
+/*
+ * Gets an address on the tracee's stack with len bytes that are free to be
+ * used for the duration of a syscall (i.e. past the red zone).
+ */
+uintptr_t ptrace_stack_scratch(pid_t pid, size_t len);
+
+/* Gets the return value of a syscall. Only valid at syscall exit. */
+long ptrace_retval(pid_t pid);
+
 /* TODO: Generic API to modify pointer arguments. */
 uintptr_t ptrace_deref_data(pid_t pid, uintptr_t addr);
 int ptrace_assign_data(pid_t pid, uintptr_t addr, uintptr_t value);
 
+/*
+ * The rest of these aren't architecture-specific, and live in generic.c.
+ */
+
+/* Copy blocks of memory from and to the tracee. */
+ssize_t ptrace_read_data(pid_t pid, uintptr_t addr, void *buf, size_t len);
+ssize_t ptrace_write_data(pid_t pid, uintptr_t addr, const void *buf, size_t len);
+
+/* Copy a NUL-terminated string from the tracee. Fails with ENAMETOOLONG. */
+ssize_t ptrace_read_string(pid_t pid, uintptr_t addr, char *buf, size_t len);
+
+/*
+ * Converts a {dirfd, path} argument pair into a path that the tracer can
+ * use to refer to the same file, by going through /proc/<pid>. If the path
+ * is empty and empty_path is set, the path refers to dirfd itself (and 1 is
+ * returned, since the magic link must then be followed). Returns -errno on
+ * failure.
+ */
+int ptrace_resolve_path(pid_t pid, int dirfd, uintptr_t path, bool empty_path, char *buf, size_t len);
+
+/*
+ * Whether the tracee is in the same namespace as us (ns is one of the names
+ * in /proc/<pid>/ns), or has the same root directory. Paths and ids that we
+ * hand to the tracee only mean the same thing to it if these hold. Both
+ * return false if they can't tell.
+ */
+bool ptrace_same_ns(pid_t pid, const char *ns);
+bool ptrace_same_root(pid_t pid);
+
 #endif
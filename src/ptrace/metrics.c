@@ -0,0 +1,164 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ptrace/metrics.c exports metrics for long-running containers. The
+ * tracing loop spends nearly all of its time waiting for stops, so rather
+ * than adding another event loop, snapshots are driven by signals which
+ * interrupt the wait (see wait.c): SIGALRM from an interval timer for
+ * files, and SIGIO for connections to the socket. The counters themselves are the
+ * ones kept for --stats (see stats.c), so the only per-stop cost is
+ * reading the clock twice.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "metrics.h"
+#include "wait.h"
+
+#define UNIX_PREFIX "unix:"
+
+volatile sig_atomic_t metrics_pending;
+
+static char *path;
+static int sock = -1;
+static pid_t owner;
+
+static void metrics_signal(int sig)
+{
+	metrics_pending = 1;
+	wait_pending = 1;
+}
+
+static void metrics_exit(void)
+{
+	/* Only the tracer, not a tracee that failed to exec(2). */
+	if (sock >= 0 && getpid() == owner)
+		unlink(path);
+}
+
+void metrics_init(const char *target, unsigned int interval)
+{
+	/* No SA_RESTART, so that a blocking waitpid(2) returns with EINTR. */
+	struct sigaction sa = {
+		.sa_handler = metrics_signal,
+	};
+	sigemptyset(&sa.sa_mask);
+
+	owner = getpid();
+	if (strncmp(target, UNIX_PREFIX, strlen(UNIX_PREFIX))) {
+		path = strdup(target);
+		if (!path)
+			die("metrics_init: out of memory");
+
+		struct itimerval timer = {
+			.it_interval = { .tv_sec = interval },
+			.it_value = { .tv_sec = interval },
+		};
+		if (sigaction(SIGALRM, &sa, NULL) < 0 || setitimer(ITIMER_REAL, &timer, NULL) < 0)
+			die("couldn't set up metrics timer: %m");
+		wait_signal(SIGALRM);
+		return;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	path = strdup(target + strlen(UNIX_PREFIX));
+	if (!path)
+		die("metrics_init: out of memory");
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("metrics socket path too long: %s", path);
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("couldn't create metrics socket: %m");
+	unlink(path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, 16) < 0)
+		die("couldn't listen on %s: %m", path);
+	atexit(metrics_exit);
+
+	/* Get a SIGIO whenever someone connects. */
+	if (sigaction(SIGIO, &sa, NULL) < 0 ||
+	    fcntl(sock, F_SETOWN, getpid()) < 0 ||
+	    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_ASYNC) < 0)
+		die("couldn't set up metrics socket: %m");
+	wait_signal(SIGIO);
+}
+
+static void export_file(const char *buf, size_t len)
+{
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		warn("couldn't write metrics to %s: %m", tmp);
+		return;
+	}
+	if (write(fd, buf, len) != (ssize_t) len || rename(tmp, path) < 0) {
+		warn("couldn't write metrics to %s: %m", path);
+		unlink(tmp);
+	}
+	close(fd);
+}
+
+static void export_socket(const char *buf, size_t len)
+{
+	int fd;
+
+	/*
+	 * A reader that doesn't keep up just gets a truncated snapshot, we
+	 * can't block the tracees on it.
+	 */
+	while ((fd = accept4(sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		send(fd, buf, len, MSG_NOSIGNAL);
+		close(fd);
+	}
+}
+
+void metrics_export(void (*render)(FILE *out))
+{
+	char *buf = NULL;
+	size_t len = 0;
+
+	metrics_pending = 0;
+
+	FILE *out = open_memstream(&buf, &len);
+	if (!out)
+		return;
+	render(out);
+	fclose(out);
+
+	if (sock < 0)
+		export_file(buf, len);
+	else
+		export_socket(buf, len);
+	free(buf);
+}
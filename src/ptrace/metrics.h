@@ -0,0 +1,41 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(PTRACE_METRICS_H)
+#define PTRACE_METRICS_H
+
+#include <signal.h>
+#include <stdio.h>
+
+/*
+ * Exports metrics in the Prometheus text format while we're tracing. If
+ * target starts with "unix:", the rest is the path of a socket that gets a
+ * snapshot written to each connection. Otherwise target is a file that
+ * is (atomically) rewritten every interval seconds.
+ */
+void metrics_init(const char *target, unsigned int interval);
+
+/*
+ * Set (from a signal handler) when a snapshot is due. The tracing loop
+ * should call metrics_export whenever it's set, which calls render to
+ * generate the snapshot.
+ */
+extern volatile sig_atomic_t metrics_pending;
+void metrics_export(void (*render)(FILE *out));
+
+#endif /* !defined(PTRACE_METRICS_H) */
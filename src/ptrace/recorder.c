@@ -0,0 +1,218 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ptrace/recorder.c writes the logs for --record. Everything needed to
+ * replay a syscall has to be in the log, so as well as the registers we
+ * copy whatever the shim read from the tracee (such as the list given to
+ * setgroups(2)), and whatever it wrote back so that replays can check
+ * that they got the same answer.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+
+#include "common.h"
+#include "record.h"
+#include "generic.h"
+#include "recorder.h"
+
+bool recording;
+
+static FILE *record_log;
+static pid_t owner;
+
+static void record_close(void)
+{
+	/* A tracee that failed to exec(2) mustn't flush our buffer as well. */
+	if (getpid() == owner && fclose(record_log))
+		warn("couldn't write record log: %m");
+}
+
+void record_open(const char *path)
+{
+	struct record_header_t header = {
+		.magic = RECORD_MAGIC,
+		.version = RECORD_VERSION,
+	};
+
+	record_log = fopen(path, "we");
+	if (!record_log)
+		die("couldn't open record log %s: %m", path);
+	if (fwrite(&header, sizeof(header), 1, record_log) != 1 || fflush(record_log))
+		die("couldn't write record log %s: %m", path);
+
+	owner = getpid();
+	recording = true;
+	atexit(record_close);
+}
+
+static void record_write(pid_t pid, enum record_kind kind, long number, const uint64_t *args,
+                         int nargs, const void *in, size_t in_len, const void *out, size_t out_len)
+{
+	struct record_t record = {
+		.pid = pid,
+		.kind = kind,
+		.nargs = nargs,
+		.number = number,
+		.in_len = in_len,
+		.out_len = out_len,
+	};
+
+	/* Tracees shouldn't die because the disk filled up, so just stop. */
+	if (fwrite(&record, sizeof(record), 1, record_log) != 1 ||
+	    fwrite(args, sizeof(*args), nargs, record_log) != (size_t) nargs ||
+	    fwrite(in, 1, in_len, record_log) != in_len ||
+	    fwrite(out, 1, out_len, record_log) != out_len) {
+		warn("couldn't write record log, no longer recording: %m");
+		recording = false;
+	}
+}
+
+/* Copies len bytes from the tracee, returning 0 (so nothing is recorded) if it can't. */
+static size_t record_read(pid_t pid, uintptr_t addr, void *buf, size_t len)
+{
+	return ptrace_read_data(pid, addr, buf, len) == (ssize_t) len ? len : 0;
+}
+
+void record_syscall(pid_t pid, long number, uintptr_t ret)
+{
+	static gid_t groups[NGROUPS_MAX];
+	struct __user_cap_header_struct header;
+	struct {
+		struct __user_cap_header_struct header;
+		struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+	} caps;
+	uint32_t ids[3];
+	const void *in = NULL, *out = NULL;
+	size_t in_len = 0, out_len = 0;
+
+	uint64_t args[7];
+	for (int i = 0; i < 6; i++)
+		args[i] = ptrace_argument(pid, i);
+	args[6] = ret;
+
+	switch (number) {
+		case SYS_setuid:
+		case SYS_getuid:
+		case SYS_setfsuid:
+		case SYS_setreuid:
+		case SYS_setresuid:
+		case SYS_geteuid:
+		case SYS_setgid:
+		case SYS_getgid:
+		case SYS_setfsgid:
+		case SYS_setregid:
+		case SYS_setresgid:
+		case SYS_getegid:
+		case SYS_prctl:
+			break;
+
+		case SYS_getresuid:
+		case SYS_getresgid:
+			for (int i = 0; i < 3; i++)
+				if (!record_read(pid, args[i], &ids[i], sizeof(ids[i])))
+					return;
+			out = ids;
+			out_len = sizeof(ids);
+			break;
+
+		case SYS_setgroups:
+			if ((int) args[0] > 0 && (int) args[0] <= NGROUPS_MAX) {
+				in_len = record_read(pid, args[1], groups, args[0] * sizeof(gid_t));
+				if (!in_len)
+					return;
+				in = groups;
+			}
+			break;
+
+		case SYS_getgroups:
+			if (args[0] && (int) ret > 0) {
+				out_len = record_read(pid, args[1], groups, ret * sizeof(gid_t));
+				if (!out_len)
+					return;
+				out = groups;
+			}
+			break;
+
+		case SYS_capget:
+			if (!record_read(pid, args[0], &header, sizeof(header)))
+				return;
+			in = &header;
+			in_len = sizeof(header);
+			if (!ret && args[1]) {
+				out_len = sizeof(caps.data[0]) * (header.version == _LINUX_CAPABILITY_VERSION_1 ? 1 : 2);
+				if (!record_read(pid, args[1], caps.data, out_len))
+					return;
+				out = caps.data;
+			}
+			break;
+
+		case SYS_capset:
+			if (!record_read(pid, args[0], &caps.header, sizeof(caps.header)))
+				return;
+			in_len = sizeof(caps.data[0]) * (caps.header.version == _LINUX_CAPABILITY_VERSION_1 ? 1 : 2);
+			if (!record_read(pid, args[1], caps.data, in_len))
+				return;
+			in = &caps;
+			in_len += sizeof(caps.header);
+			break;
+
+		default:
+			return;
+	}
+
+	record_write(pid, RECORD_SYSCALL, number, args, 7, in, in_len, out, out_len);
+}
+
+void record_root(pid_t pid, const struct cred_t *cred)
+{
+	uint64_t args[RECORD_ROOT_NARGS] = {
+		cred->uid, cred->euid, cred->suid, cred->fsuid,
+		cred->gid, cred->egid, cred->sgid, cred->fsgid,
+		cred->securebits,
+		cred->cap_inheritable, cred->cap_permitted, cred->cap_effective,
+		cred->cap_bset, cred->cap_ambient,
+	};
+	record_write(pid, RECORD_ROOT, 0, args, RECORD_ROOT_NARGS,
+	             cred->groups, cred->ngroups * sizeof(gid_t), NULL, 0);
+}
+
+void record_clone(pid_t pid, pid_t child)
+{
+	uint64_t args[1] = { child };
+	record_write(pid, RECORD_CLONE, 0, args, 1, NULL, 0, NULL, 0);
+}
+
+void record_exec(pid_t pid, pid_t former, const struct cred_bprm_t *bprm)
+{
+	uint64_t args[1] = { former };
+	record_write(pid, RECORD_EXEC, 0, args, 1, bprm, sizeof(*bprm), NULL, 0);
+}
+
+void record_exit(pid_t pid)
+{
+	record_write(pid, RECORD_EXIT, 0, NULL, 0, NULL, 0, NULL, 0);
+}
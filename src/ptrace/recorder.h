@@ -0,0 +1,44 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(PTRACE_RECORDER_H)
+#define PTRACE_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "core/cred.h"
+
+/*
+ * Records every emulated credential syscall (and the lifetime of each
+ * tracee) to a log at path, which remainroot-replay can run through the
+ * emulation again. See record.h for the format.
+ */
+void record_open(const char *path);
+extern bool recording;
+
+/* Records a syscall that was just emulated at entry, with the result ret. */
+void record_syscall(pid_t pid, long number, uintptr_t ret);
+
+void record_root(pid_t pid, const struct cred_t *cred);
+void record_clone(pid_t pid, pid_t child);
+void record_exec(pid_t pid, pid_t former, const struct cred_bprm_t *bprm);
+void record_exit(pid_t pid);
+
+#endif /* !defined(PTRACE_RECORDER_H) */
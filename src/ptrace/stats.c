@@ -0,0 +1,257 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ptrace/stats.c keeps track of where the tracer spends its time (see
+ * --stats). Every stop is timed from when waitpid(2) returns it to when the
+ * tracee is resumed. Latencies go in log2 histograms, so the percentiles
+ * are only accurate to within a factor of two, but keeping them costs a
+ * few instructions per stop.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "ohmic/ohmic.h"
+#include "stats.h"
+
+/* Generated from <sys/syscall.h> by the build (see Makefile.am). */
+static const char *syscall_names[] = {
+#define SYSCALL_NAME(name) [__NR_ ## name] = #name,
+#include "ptrace/syscall-names.h"
+#undef SYSCALL_NAME
+};
+
+#define NR_SYSCALLS (sizeof(syscall_names) / sizeof(*syscall_names))
+#define NR_BUCKETS  64
+
+struct stats_t {
+	const char *name;
+	uint64_t stops;
+	uint64_t syscalls;
+	uint64_t emulated;
+	uint64_t ns;
+	/* hist[i] counts calls that took [2^i, 2^(i+1)) ns. */
+	uint64_t hist[NR_BUCKETS];
+};
+
+bool stats_enabled, stats_summary;
+
+static struct stats_t *syscalls;
+static struct stats_t *exes;
+static unsigned int nr_exes;
+
+/* path -> index in exes. */
+static struct ohm_t *exe_hm;
+
+void stats_enable(bool summary)
+{
+	stats_summary |= summary;
+	if (stats_enabled)
+		return;
+	stats_enabled = true;
+
+	/* One more for syscalls that we don't have a name for. */
+	syscalls = calloc(NR_SYSCALLS + 1, sizeof(*syscalls));
+	exe_hm = ohm_init(64, ohm_hash);
+	if (!syscalls || !exe_hm)
+		die("stats_enable: out of memory");
+	stats_exe("(unknown)");
+}
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+unsigned int stats_exe(const char *path)
+{
+	unsigned int *index = ohm_search(exe_hm, (void *) path, strlen(path));
+	if (index)
+		return *index;
+
+	struct stats_t *new = realloc(exes, (nr_exes + 1) * sizeof(*exes));
+	if (!new)
+		die("stats_exe: out of memory");
+	exes = new;
+
+	index = ohm_insert(exe_hm, (void *) path, strlen(path), &nr_exes, sizeof(nr_exes));
+	if (!index)
+		die("stats_exe: out of memory");
+
+	exes[nr_exes] = (struct stats_t) { .name = strdup(path) };
+	return nr_exes++;
+}
+
+static void stats_add(struct stats_t *stats, uint64_t ns)
+{
+	stats->ns += ns;
+	stats->hist[ns ? 63 - __builtin_clzll(ns) : 0]++;
+}
+
+void stats_stop(unsigned int exe, uint64_t ns)
+{
+	exes[exe].stops++;
+	exes[exe].ns += ns;
+}
+
+void stats_syscall(unsigned int exe, long number, bool emulated, uint64_t ns)
+{
+	struct stats_t *sc = &syscalls[number >= 0 && (size_t) number < NR_SYSCALLS ? (size_t) number : (size_t) NR_SYSCALLS];
+
+	sc->stops += 2;
+	sc->syscalls++;
+	sc->emulated += emulated;
+	stats_add(sc, ns);
+
+	exes[exe].stops += 2;
+	exes[exe].syscalls++;
+	exes[exe].emulated += emulated;
+	stats_add(&exes[exe], ns);
+}
+
+/* The upper bound of the bucket containing the pct-th percentile, in ns. */
+static uint64_t percentile(struct stats_t *stats, unsigned int pct)
+{
+	uint64_t target = (stats->syscalls * pct + 99) / 100, seen = 0;
+
+	for (int i = 0; i < NR_BUCKETS; i++) {
+		seen += stats->hist[i];
+		if (seen >= target)
+			return 2ULL << i;
+	}
+	return 0;
+}
+
+static int stats_compare(const void *a, const void *b)
+{
+	const struct stats_t *x = a, *y = b;
+	return (x->ns < y->ns) - (x->ns > y->ns);
+}
+
+static void print_table(FILE *out, const char *what, struct stats_t *stats, size_t n)
+{
+	uint64_t total = 0;
+
+	qsort(stats, n, sizeof(*stats), stats_compare);
+	for (size_t i = 0; i < n; i++)
+		total += stats[i].ns;
+
+	fprintf(out, "%6s %11s %10s %10s %10s %9s %9s  %s\n", "% time", "seconds", "stops",
+	        "calls", "emulated", "p50 (us)", "p99 (us)", what);
+	for (size_t i = 0; i < n; i++) {
+		struct stats_t *s = &stats[i];
+		if (!s->stops)
+			continue;
+		fprintf(out, "%6.2f %11.6f %10llu %10llu %10llu %9.1f %9.1f  %s\n",
+		        total ? 100.0 * s->ns / total : 0.0, s->ns / 1e9,
+		        (unsigned long long) s->stops, (unsigned long long) s->syscalls,
+		        (unsigned long long) s->emulated, percentile(s, 50) / 1e3,
+		        percentile(s, 99) / 1e3, s->name);
+	}
+	fprintf(out, "\n");
+}
+
+void stats_print(FILE *out)
+{
+	static char unnamed[NR_SYSCALLS][24];
+
+	/* The tables get sorted, so print copies of them. */
+	struct stats_t *copy = malloc((NR_SYSCALLS + 1 + nr_exes) * sizeof(*copy));
+	if (!copy)
+		return;
+	memcpy(copy, syscalls, (NR_SYSCALLS + 1) * sizeof(*copy));
+	memcpy(copy + NR_SYSCALLS + 1, exes, nr_exes * sizeof(*copy));
+
+	for (size_t i = 0; i < NR_SYSCALLS; i++) {
+		copy[i].name = syscall_names[i];
+		if (!copy[i].name) {
+			snprintf(unnamed[i], sizeof(unnamed[i]), "syscall_%zu", i);
+			copy[i].name = unnamed[i];
+		}
+	}
+	copy[NR_SYSCALLS].name = "(other)";
+
+	print_table(out, "syscall", copy, NR_SYSCALLS + 1);
+	print_table(out, "executable", copy + NR_SYSCALLS + 1, nr_exes);
+	free(copy);
+}
+
+/* Bounds of the exported histogram buckets, as powers of two (1us to 17s). */
+#define METRICS_MIN_BUCKET 10
+#define METRICS_MAX_BUCKET 34
+
+void stats_metrics(FILE *out)
+{
+	uint64_t stops = 0, calls = 0, ns = 0, hist[NR_BUCKETS] = {0};
+
+	for (unsigned int i = 0; i < nr_exes; i++)
+		stops += exes[i].stops;
+
+	fprintf(out, "# HELP remainroot_stops_total Tracee stops handled by the tracer.\n");
+	fprintf(out, "# TYPE remainroot_stops_total counter\n");
+	fprintf(out, "remainroot_stops_total %llu\n", (unsigned long long) stops);
+
+	fprintf(out, "# HELP remainroot_syscalls_total Traced syscalls, by name.\n");
+	fprintf(out, "# TYPE remainroot_syscalls_total counter\n");
+	for (size_t i = 0; i <= NR_SYSCALLS; i++) {
+		struct stats_t *s = &syscalls[i];
+		if (!s->syscalls)
+			continue;
+		if (i < NR_SYSCALLS && syscall_names[i])
+			fprintf(out, "remainroot_syscalls_total{syscall=\"%s\"} %llu\n",
+			        syscall_names[i], (unsigned long long) s->syscalls);
+		else
+			fprintf(out, "remainroot_syscalls_total{syscall=\"%zu\"} %llu\n",
+			        i, (unsigned long long) s->syscalls);
+
+		calls += s->syscalls;
+		ns += s->ns;
+		for (int j = 0; j < NR_BUCKETS; j++)
+			hist[j] += s->hist[j];
+	}
+
+	fprintf(out, "# HELP remainroot_syscalls_emulated_total Traced syscalls whose result was faked, by name.\n");
+	fprintf(out, "# TYPE remainroot_syscalls_emulated_total counter\n");
+	for (size_t i = 0; i < NR_SYSCALLS; i++)
+		if (syscalls[i].emulated && syscall_names[i])
+			fprintf(out, "remainroot_syscalls_emulated_total{syscall=\"%s\"} %llu\n",
+			        syscall_names[i], (unsigned long long) syscalls[i].emulated);
+
+	fprintf(out, "# HELP remainroot_syscall_duration_seconds Time spent in the tracer per syscall.\n");
+	fprintf(out, "# TYPE remainroot_syscall_duration_seconds histogram\n");
+	uint64_t seen = 0;
+	for (int i = 0; i < METRICS_MAX_BUCKET; i++) {
+		seen += hist[i];
+		if (i + 1 >= METRICS_MIN_BUCKET)
+			fprintf(out, "remainroot_syscall_duration_seconds_bucket{le=\"%g\"} %llu\n",
+			        (2ULL << i) / 1e9, (unsigned long long) seen);
+	}
+	fprintf(out, "remainroot_syscall_duration_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long) calls);
+	fprintf(out, "remainroot_syscall_duration_seconds_sum %.9f\n", ns / 1e9);
+	fprintf(out, "remainroot_syscall_duration_seconds_count %llu\n", (unsigned long long) calls);
+}
@@ -0,0 +1,59 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(PTRACE_STATS_H)
+#define PTRACE_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Statistics about what tracing costs, kept per syscall and per
+ * executable. Nothing is collected unless stats_enable was called. If
+ * summary is set, the tracer should print the tables once the root
+ * tracee exits.
+ */
+void stats_enable(bool summary);
+extern bool stats_enabled, stats_summary;
+
+/* The monotonic clock, in nanoseconds. */
+uint64_t stats_now(void);
+
+/*
+ * Executables are referred to by an index, which is kept in each proc_t.
+ * Index 0 is whatever was running before the first execve(2) we saw.
+ */
+unsigned int stats_exe(const char *path);
+
+/* Records a stop that took ns to deal with, which wasn't part of a syscall. */
+void stats_stop(unsigned int exe, uint64_t ns);
+
+/*
+ * Records a complete syscall (entry and exit stops), which took ns to deal
+ * with in total. emulated is whether the return value was replaced.
+ */
+void stats_syscall(unsigned int exe, long number, bool emulated, uint64_t ns);
+
+/* Prints the tables, each sorted by the time spent in the tracer. */
+void stats_print(FILE *out);
+
+/* Prints the counters and latency histogram in the Prometheus text format. */
+void stats_metrics(FILE *out);
+
+#endif /* !defined(PTRACE_STATS_H) */
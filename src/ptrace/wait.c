@@ -0,0 +1,205 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * ptrace/wait.c is how the tracing loop waits for stops. Every syscall a
+ * tracee makes costs two round trips through the scheduler (the tracee
+ * wakes us, we wake it), and when the tracer has gone to sleep in
+ * waitpid(2) each of those is a full wakeup. Polling with WNOHANG for a
+ * little while after resuming a tracee means that the next stop is
+ * usually picked up as soon as it happens.
+ *
+ * Spinning only pays off if the next stop comes soon, so the budget
+ * follows the gaps we actually see: a stop that arrives within the limit
+ * grows the budget to twice that gap, and one that doesn't halves it. A
+ * burst of syscalls quickly gets the whole budget, and once things go
+ * quiet the budget decays to nothing and we're back to blocking.
+ *
+ * The tracing loop also has work that doesn't come from tracees (metrics,
+ * control connections and daemon launchers), which signals tell it about.
+ * A signal that arrives after the loop has checked for work but before it
+ * blocks in waitpid(2) would go unnoticed until some tracee stops, which
+ * for an idle container may be never. So those signals are kept blocked,
+ * and we sleep in sigsuspend(2) (woken by SIGCHLD for stops) rather than
+ * in waitpid(2). That costs a few more syscalls per stop, so it's only
+ * done if something asked for it with wait_signal.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "stats.h"
+#include "wait.h"
+
+/* Below this, polling isn't worth the clock reads. */
+#define SPIN_MIN_NS 1000
+
+static uint64_t limit, budget;
+
+volatile sig_atomic_t wait_pending;
+
+/* The signals (plus SIGCHLD) that wake us up, and our mask while asleep. */
+static sigset_t wake, asleep;
+static bool interruptible, blocked;
+
+static void wait_child(int sig)
+{
+	/* Only here so that sigsuspend(2) returns. */
+}
+
+void wait_signal(int sig)
+{
+	if (!interruptible) {
+		/* No SA_NOCLDSTOP, we need to hear about every stop. */
+		struct sigaction sa = {
+			.sa_handler = wait_child,
+		};
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGCHLD, &sa, NULL) < 0)
+			die("couldn't set up SIGCHLD handler: %m");
+
+		sigemptyset(&wake);
+		sigaddset(&wake, SIGCHLD);
+		interruptible = true;
+	}
+	sigaddset(&wake, sig);
+}
+
+/*
+ * Blocks the wake-up signals, the first time we wait. This isn't done in
+ * wait_signal, because the tracee we fork would inherit the mask.
+ */
+static void wait_block(void)
+{
+	if (blocked)
+		return;
+
+	if (sigprocmask(SIG_BLOCK, &wake, &asleep) < 0)
+		die("couldn't block signals: %m");
+	for (int sig = 1; sig < NSIG; sig++)
+		if (sigismember(&wake, sig))
+			sigdelset(&asleep, sig);
+	blocked = true;
+}
+
+/*
+ * Waits for a stop with the wake-up signals blocked, so that there's no
+ * point at which one of them could arrive without us noticing.
+ */
+static pid_t wait_sleep(int *status)
+{
+	for (;;) {
+		if (wait_pending) {
+			errno = EINTR;
+			return -1;
+		}
+
+		pid_t pid = waitpid(-1, status, __WALL | WNOHANG);
+		if (pid)
+			return pid;
+		sigsuspend(&asleep);
+	}
+}
+
+void wait_idle(void)
+{
+	if (!interruptible)
+		die("wait_idle: nothing to wake us up");
+
+	wait_block();
+	while (!wait_pending)
+		sigsuspend(&asleep);
+}
+
+void wait_spin(unsigned int usec)
+{
+	cpu_set_t cpus;
+
+	/* With a single CPU, the tracee can't get anything done while we poll. */
+	if (!sched_getaffinity(0, sizeof(cpus), &cpus) && CPU_COUNT(&cpus) < 2) {
+		warn("only one cpu available, not spinning");
+		return;
+	}
+
+	limit = budget = (uint64_t) usec * 1000;
+}
+
+/* Polls for a stop until deadline, returning 0 if there wasn't one. */
+static pid_t wait_poll(int *status, uint64_t deadline)
+{
+	pid_t pid = 0;
+
+	/* Let the wake-up signals in, so they can cut polling short. */
+	if (interruptible)
+		sigprocmask(SIG_SETMASK, &asleep, NULL);
+
+	do {
+		pid = waitpid(-1, status, __WALL | WNOHANG);
+		if (pid)
+			break;
+
+		/* The caller has to see signals, as it would with a blocking wait. */
+		if (wait_pending) {
+			errno = EINTR;
+			pid = -1;
+			break;
+		}
+	} while (stats_now() < deadline);
+
+	if (interruptible)
+		sigprocmask(SIG_BLOCK, &wake, NULL);
+	return pid;
+}
+
+pid_t wait_stop(int *status)
+{
+	if (!limit && !interruptible)
+		return waitpid(-1, status, __WALL);
+
+	if (interruptible)
+		wait_block();
+	if (!limit)
+		return wait_sleep(status);
+
+	uint64_t start = stats_now();
+	pid_t pid = 0;
+
+	if (budget >= SPIN_MIN_NS)
+		pid = wait_poll(status, start + budget);
+	if (!pid)
+		pid = interruptible ? wait_sleep(status) : waitpid(-1, status, __WALL);
+	if (pid < 0)
+		return pid;
+
+	uint64_t gap = stats_now() - start;
+	if (gap <= limit)
+		budget = 2 * gap > budget ? 2 * gap : budget;
+	else
+		budget /= 2;
+	if (budget > limit)
+		budget = limit;
+	return pid;
+}
@@ -0,0 +1,56 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if !defined(PTRACE_WAIT_H)
+#define PTRACE_WAIT_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+/*
+ * Waits for the next stop of any tracee, as waitpid(-1, status, __WALL)
+ * does (including failing with EINTR if a signal arrived).
+ *
+ * By default this just blocks. If wait_spin was called, it first polls
+ * for up to usec microseconds, which avoids the scheduler's wakeup
+ * latency when tracees stop in quick succession, at the cost of burning
+ * CPU. How long it actually polls adapts to how far apart stops are, so
+ * an idle tracee goes back to blocking.
+ */
+void wait_spin(unsigned int usec);
+pid_t wait_stop(int *status);
+
+/*
+ * Makes sig (which must already have a handler) interrupt wait_stop. The
+ * handler has to set wait_pending as well as its own flag, and the tracing
+ * loop has to clear wait_pending before it checks those flags. From the
+ * first wait_stop on, sig is blocked other than while we wait, so the loop
+ * can't miss one that arrives just after it checked.
+ */
+void wait_signal(int sig);
+extern volatile sig_atomic_t wait_pending;
+
+/*
+ * Sleeps until one of the wait_signal signals arrives, for when there are
+ * no tracees to wait for. Like wait_stop, this returns straight away if
+ * wait_pending was set since the loop cleared it.
+ */
+void wait_idle(void);
+
+#endif /* !defined(PTRACE_WAIT_H) */
@@ -0,0 +1,77 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * record.h is the format of the logs written by --record and read by
+ * remainroot-replay. A log is a record_header_t followed by a stream of
+ * events, each of which is a record_t followed by nargs arguments (and
+ * the result, for syscalls), then in_len bytes of input read from the
+ * tracee and out_len bytes of output written to it. Everything is in
+ * host byte order, since logs are only meant to be replayed on the same
+ * kind of machine they were recorded on.
+ */
+
+#if !defined(REMAINROOT_RECORD_H)
+#define REMAINROOT_RECORD_H
+
+#include <stdint.h>
+
+#define RECORD_MAGIC   "RRTRACE"
+#define RECORD_VERSION 2
+
+struct record_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t __pad;
+};
+
+enum record_kind {
+	/*
+	 * An emulated syscall: args are the registers, then the result. Only
+	 * the ones from core/cred.h (and prctl(2)) are recorded, since the
+	 * rest depend on the filesystem.
+	 */
+	RECORD_SYSCALL = 1,
+	/* pid forked (or cloned) args[0]. */
+	RECORD_CLONE,
+	/* pid finished an execve(2) started by args[0], input is a cred_bprm_t. */
+	RECORD_EXEC,
+	/* pid was reaped. */
+	RECORD_EXIT,
+	/*
+	 * pid is the root of a new tree, with the credentials it started out
+	 * with (which depend on who ran us): args are the uid, euid, suid,
+	 * fsuid, gid, egid, sgid, fsgid, securebits and the inheritable,
+	 * permitted, effective, bounding and ambient sets. Input is the groups.
+	 */
+	RECORD_ROOT,
+};
+
+#define RECORD_ROOT_NARGS 14
+
+struct record_t {
+	uint32_t pid;
+	uint16_t kind;
+	uint16_t nargs;
+	uint32_t number;
+	uint32_t in_len;
+	uint32_t out_len;
+	uint32_t __pad;
+};
+
+#endif /* !defined(REMAINROOT_RECORD_H) */
@@ -18,17 +18,32 @@
 
 /* Main wrapper for core/, preload/ and ptrace/ */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
 
 /* All of the boilerplate text. */
 #include "info.h"
 #include "common.h"
 #include "shims.h"
+#include "core/cred.h"
+#include "core/file.h"
+#include "core/rlimit.h"
+#include "ptrace/control.h"
+#include "ptrace/daemon.h"
+#include "ptrace/metrics.h"
+#include "ptrace/recorder.h"
+#include "ptrace/stats.h"
+#include "ptrace/wait.h"
 
 void usage(void)
 {
@@ -63,18 +78,48 @@ struct shim_t *get_shim(char *name)
 
 #define DEFAULT_SHIM "ptrace"
 
+/* Which namespaces --userns should set up. */
+#define USERNS_USER  (1 << 0)
+#define USERNS_MOUNT (1 << 1)
+
 struct config_t {
 	struct shim_t shim;
+	char *state_file;
+	bool xattr;
+	bool log_rlimits;
+	bool stats;
+	char *metrics;
+	unsigned int metrics_interval;
+	char *record;
+	unsigned int spin;
+	int userns;
+	char *daemon;
+	unsigned int workers;
+	char *connect;
+	char *control;
 };
 
 void bake_args(struct config_t *config, int argc, char **argv)
 {
 	int c;
 	struct option long_options[] = {
-		{"shim-type", required_argument, NULL, 's'},
-		{  "license",       no_argument, NULL, 'L'},
-		{     "help",       no_argument, NULL, 'h'},
-		{          0,                 0, NULL,   0},
+		{       "shim-type", required_argument, NULL, 's'},
+		{      "state-file", required_argument, NULL, 'S'},
+		{           "xattr",       no_argument, NULL, 'X'},
+		{     "log-rlimits",       no_argument, NULL, 'R'},
+		{           "stats",       no_argument, NULL, 'c'},
+		{         "metrics", required_argument, NULL, 'm'},
+		{"metrics-interval", required_argument, NULL, 'M'},
+		{          "record", required_argument, NULL, 'r'},
+		{            "spin", required_argument, NULL, 'w'},
+		{          "userns", optional_argument, NULL, 'U'},
+		{          "daemon", required_argument, NULL, 'D'},
+		{         "workers", required_argument, NULL, 'j'},
+		{         "connect", required_argument, NULL, 'C'},
+		{         "control", required_argument, NULL, 'K'},
+		{         "license",       no_argument, NULL, 'L'},
+		{            "help",       no_argument, NULL, 'h'},
+		{                 0,                 0, NULL,   0},
 	};
 
 	/* Parse the default shim. */
@@ -88,7 +133,7 @@ void bake_args(struct config_t *config, int argc, char **argv)
 	 * extension. But we could similarly use POSIXLY_CORRECT.
 	 */
 
-	while ((c = getopt_long(argc, argv, "+s:hL", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "+s:S:XRcm:M:r:w:U::D:j:C:K:hL", long_options, NULL)) != -1) {
 		switch (c) {
 			case 's':
 				shim = get_shim(optarg);
@@ -97,6 +142,55 @@ void bake_args(struct config_t *config, int argc, char **argv)
 				else
 					rtfm("invalid shim type: %s", optarg);
 				break;
+			case 'S':
+				config->state_file = optarg;
+				break;
+			case 'X':
+				config->xattr = true;
+				break;
+			case 'R':
+				config->log_rlimits = true;
+				break;
+			case 'c':
+				config->stats = true;
+				break;
+			case 'm':
+				config->metrics = optarg;
+				break;
+			case 'M':
+				if (atoi(optarg) <= 0)
+					rtfm("invalid metrics interval: %s", optarg);
+				config->metrics_interval = atoi(optarg);
+				break;
+			case 'r':
+				config->record = optarg;
+				break;
+			case 'w':
+				if (atoi(optarg) <= 0)
+					rtfm("invalid spin time: %s", optarg);
+				config->spin = atoi(optarg);
+				break;
+			case 'U':
+				config->userns = USERNS_USER;
+				if (optarg && !strcmp(optarg, "mount"))
+					config->userns |= USERNS_MOUNT;
+				else if (optarg)
+					rtfm("invalid namespace: %s", optarg);
+				break;
+			case 'D':
+				config->daemon = optarg;
+				break;
+			case 'j':
+				if (atoi(optarg) <= 0)
+					rtfm("invalid number of workers: %s", optarg);
+				config->workers = atoi(optarg);
+				break;
+			case 'C':
+				config->connect = optarg;
+				break;
+			case 'K':
+				config->control = optarg;
+				break;
 			case 'L':
 				license();
 				exit(0);
@@ -113,6 +207,53 @@ void bake_args(struct config_t *config, int argc, char **argv)
 
 	if (!config->shim.fn)
 		rtfm("shim type required");
+
+	/* These all assume there's a single program being traced. */
+	if (config->daemon && (config->stats || config->metrics || config->record || config->control))
+		rtfm("--daemon can't be used with --stats, --metrics, --record or --control");
+	/* Each container gets faked file metadata of its own, which is never saved. */
+	if (config->daemon && config->state_file)
+		rtfm("--daemon can't be used with --state-file");
+}
+
+static void write_file(const char *path, const char *data)
+{
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		die("open(%s) failed: %m", path);
+
+	ssize_t len = strlen(data);
+	if (write(fd, data, len) != len)
+		die("write(%s) failed: %m", path);
+	close(fd);
+}
+
+/*
+ * Sets up a rootless container of our own, so that we don't need a
+ * separate runtime to create one for us. It's the simplest possible one:
+ * our uid and gid are mapped to root, and nothing else is mapped (which
+ * is all an unprivileged user can do without newuidmap(1)). Everything
+ * else that root can do, we fake.
+ */
+static void enter_userns(int flags)
+{
+	char map[64];
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+
+	if (unshare(CLONE_NEWUSER | (flags & USERNS_MOUNT ? CLONE_NEWNS : 0)) < 0)
+		die("unshare failed: %m");
+
+	/* The kernel refuses to let us write gid_map until setgroups(2) is disabled. */
+	write_file("/proc/self/setgroups", "deny");
+	snprintf(map, sizeof(map), "0 %u 1\n", uid);
+	write_file("/proc/self/uid_map", map);
+	snprintf(map, sizeof(map), "0 %u 1\n", gid);
+	write_file("/proc/self/gid_map", map);
+
+	/* Make sure that no mounts made inside leak out. */
+	if (flags & USERNS_MOUNT && mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0)
+		die("couldn't make mounts private: %m");
 }
 
 int main(int argc, char **argv)
@@ -124,6 +265,62 @@ int main(int argc, char **argv)
 	argv += optind;
 	argc -= optind;
 
+	/* Launchers don't do anything else, the supervisor has it covered. */
+	if (config.connect) {
+		if (!argc)
+			rtfm("program required");
+		daemon_connect(config.connect);
+		execvp(argv[0], argv);
+		die("couldn't exec %s: %m", argv[0]);
+	}
+
+	/*
+	 * If we're already being traced by remainroot, we can't trace the
+	 * program ourselves, and stacking tracers would be slow anyway. Get the
+	 * outer one to treat us as a new container instead. The environment
+	 * could be stale, but then the kernel just rejects the prctl(2). This
+	 * has to happen before we set up a container of our own, since the
+	 * outer one would be faking that as well.
+	 */
+	if (!config.daemon && argc && getenv(SUPERVISOR_ENV)) {
+		if (!prctl(PR_REMAINROOT_NEW_DOMAIN, 0, 0, 0, 0)) {
+			if (config.userns)
+				die("already traced by remainroot (pid %s), which can't run %s in a user "
+				    "namespace of its own (drop --userns)", getenv(SUPERVISOR_ENV), argv[0]);
+			if (config.state_file || config.xattr || config.stats || config.metrics || config.record || config.control)
+				warn("already traced by remainroot (pid %s), which keeps the state", getenv(SUPERVISOR_ENV));
+			execvp(argv[0], argv);
+			die("couldn't exec %s: %m", argv[0]);
+		}
+		if (errno == EPERM)
+			die("already traced by remainroot (pid %s), which only gives new credentials to "
+			    "processes with CAP_SETUID and CAP_SETGID", getenv(SUPERVISOR_ENV));
+	}
+
+	/* Everything after this has to happen inside the container. */
+	if (config.userns)
+		enter_userns(config.userns);
+
+	/* Load any faked file metadata from previous runs. */
+	if (config.state_file)
+		file_open_state(config.state_file);
+	if (config.xattr)
+		file_use_xattr();
+	if (config.log_rlimits)
+		rlimit_log_clamps();
+	if (config.stats || config.metrics)
+		stats_enable(config.stats);
+	if (config.metrics)
+		metrics_init(config.metrics, config.metrics_interval ? : 10);
+	if (config.record)
+		record_open(config.record);
+	if (config.spin)
+		wait_spin(config.spin);
+	if (config.control)
+		control_init(config.control);
+	if (config.daemon)
+		daemon_init(config.daemon, config.workers ? : 1, shim_ptrace_serve);
+
 	/* In to the shim we go. */
 	config.shim.fn(argc, argv);
 
@@ -0,0 +1,431 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * remainroot-replay runs a log written by `remainroot --record` back
+ * through the emulation in core/, without any real processes or ptrace(2)
+ * involved. Each syscall's result (and anything it would have written to
+ * the tracee) is checked against what was recorded, so a log from a real
+ * workload doubles as a regression test, and the time taken doubles as a
+ * benchmark of the emulation itself.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+
+#include "common.h"
+#include "record.h"
+#include "ohmic/ohmic.h"
+#include "core/proc.h"
+#include "core/cred.h"
+
+#define REPLAY_USAGE \
+"usage: %s [-n <passes>] [-q] <log>\n" \
+"\n" \
+"Replays a log written by `remainroot --record` through the emulation,\n" \
+"checking that every syscall gives the same result as it did when it was\n" \
+"recorded, and reports how long the emulation took.\n" \
+"\n" \
+"options:\n" \
+"  -h, --help              show this help page\n" \
+"  -n, --passes <n>        replay the log <n> times, reporting the fastest\n" \
+"                          (the default is 1)\n" \
+"  -q, --quiet             don't print each mismatch\n"
+
+void usage(void)
+{
+	fprintf(stderr, REPLAY_USAGE, __progname);
+}
+
+struct replay_t {
+	/* pid -> proc_t, like pid_hm in ptrace.c. */
+	struct ohm_t *procs;
+
+	unsigned long events;
+	unsigned long syscalls;
+	unsigned long mismatches;
+	bool quiet;
+};
+
+static struct proc_t *replay_proc(struct replay_t *replay, pid_t pid)
+{
+	struct proc_t *proc = ohm_search(replay->procs, &pid, sizeof(pid));
+	if (proc)
+		return proc;
+
+	/*
+	 * Roots are set up by their RECORD_ROOT, so this is a pid that was never
+	 * traced (such as the target of a capget(2)). Guess that it's root.
+	 */
+	struct proc_t new = {0};
+	proc_new(&new);
+	new.pid = pid;
+	proc = ohm_insert(replay->procs, &pid, sizeof(pid), &new, sizeof(new));
+	if (!proc)
+		die("ohm_insert(%d) failed", pid);
+	return proc;
+}
+
+/*
+ * Runs a recorded syscall through the same __rr_do_* call as its shim in
+ * ptrace/generic-shims.c would, filling out with whatever the shim would
+ * have written to the tracee.
+ */
+static uintptr_t replay_syscall(struct replay_t *replay, struct proc_t *proc,
+                                const struct record_t *record, const uint64_t *args,
+                                const void *in, void *out, size_t *out_len)
+{
+	struct cred_t *cred = &proc->cred;
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {0};
+	uintptr_t ret;
+	uint32_t ids[3];
+
+	*out_len = 0;
+	switch (record->number) {
+		case SYS_setuid:
+			return __rr_do_setuid(cred, args[0]);
+		case SYS_getuid:
+			return __rr_do_getuid(cred);
+		case SYS_setfsuid:
+			return __rr_do_setfsuid(cred, args[0]);
+		case SYS_setreuid:
+			return __rr_do_setreuid(cred, args[0], args[1]);
+		case SYS_setresuid:
+			return __rr_do_setresuid(cred, args[0], args[1], args[2]);
+		case SYS_geteuid:
+			return __rr_do_geteuid(cred);
+		case SYS_setgid:
+			return __rr_do_setgid(cred, args[0]);
+		case SYS_getgid:
+			return __rr_do_getgid(cred);
+		case SYS_setfsgid:
+			return __rr_do_setfsgid(cred, args[0]);
+		case SYS_setregid:
+			return __rr_do_setregid(cred, args[0], args[1]);
+		case SYS_setresgid:
+			return __rr_do_setresgid(cred, args[0], args[1], args[2]);
+		case SYS_getegid:
+			return __rr_do_getegid(cred);
+
+		case SYS_getresuid:
+		case SYS_getresgid:
+			if (record->number == SYS_getresuid)
+				ret = __rr_do_getresuid(cred, &ids[0], &ids[1], &ids[2]);
+			else
+				ret = __rr_do_getresgid(cred, &ids[0], &ids[1], &ids[2]);
+			memcpy(out, ids, sizeof(ids));
+			*out_len = sizeof(ids);
+			return ret;
+
+		case SYS_setgroups:
+			return __rr_do_setgroups(cred, args[0], in);
+
+		case SYS_getgroups:
+			ret = __rr_do_getgroups(cred, args[0], out);
+			if ((int) ret > 0 && args[0])
+				*out_len = ret * sizeof(gid_t);
+			return ret;
+
+		case SYS_capget:
+			memcpy(&header, in, sizeof(header));
+			if (header.pid && header.pid != proc->pid)
+				proc = replay_proc(replay, header.pid);
+			ret = __rr_do_capget(&proc->cred, &header, args[1] ? data : NULL);
+			if (!ret && args[1]) {
+				*out_len = sizeof(data[0]) * (header.version == _LINUX_CAPABILITY_VERSION_1 ? 1 : 2);
+				memcpy(out, data, *out_len);
+			}
+			return ret;
+
+		case SYS_capset:
+			memcpy(&header, in, sizeof(header));
+			memcpy(data, (char *) in + sizeof(header), record->in_len - sizeof(header));
+			if (header.pid == proc->pid)
+				header.pid = 0;
+			return __rr_do_capset(cred, &header, data);
+
+		case SYS_prctl:
+			return cred_prctl(cred, args[0], args[1], args[2], args[3], args[4]);
+	}
+
+	die("can't replay syscall %u", record->number);
+}
+
+/* Whether the input of a recorded syscall is what replay_syscall expects. */
+static bool replay_check_input(const struct record_t *record, const uint64_t *args)
+{
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+	int size = args[0];
+
+	switch (record->number) {
+		case SYS_setgroups:
+			/* Invalid sizes fail before the list is read. */
+			return size < 0 || size > NGROUPS_MAX || record->in_len == size * sizeof(gid_t);
+		case SYS_capget:
+			return record->in_len == sizeof(header);
+		case SYS_capset:
+			return record->in_len >= sizeof(header) && record->in_len - sizeof(header) <= sizeof(data);
+		default:
+			return true;
+	}
+}
+
+/*
+ * Checks that the event at the start of the len bytes left in the log is
+ * well-formed, and returns its size. Logs come from wherever, so nothing in
+ * an event is used until it has been checked. A malformed event means the
+ * rest of the log can't be trusted either, so that's fatal.
+ */
+static size_t replay_check(struct replay_t *replay, const char *event, size_t len)
+{
+	unsigned long n = replay->events + 1;
+	struct record_t record;
+
+	if (len < sizeof(record))
+		die("event %lu is truncated", n);
+	memcpy(&record, event, sizeof(record));
+
+	size_t size = sizeof(record) + record.nargs * sizeof(uint64_t) +
+	              (size_t) record.in_len + record.out_len;
+	if (size > len)
+		die("event %lu is truncated", n);
+
+	const uint64_t *args = (const void *) (event + sizeof(record));
+	switch (record.kind) {
+		case RECORD_SYSCALL:
+			/* Six registers, then the result. */
+			if (record.nargs < 7 || !replay_check_input(&record, args))
+				die("event %lu: malformed syscall %u", n, record.number);
+			break;
+		case RECORD_CLONE:
+			if (record.nargs < 1)
+				die("event %lu: malformed clone", n);
+			break;
+		case RECORD_EXEC:
+			if (record.nargs < 1 || record.in_len != sizeof(struct cred_bprm_t))
+				die("event %lu: malformed exec", n);
+			break;
+		case RECORD_EXIT:
+			break;
+		case RECORD_ROOT: {
+			/* The groups have to be sorted, as in a cred_t. */
+			const gid_t *groups = (const void *) (args + record.nargs);
+			size_t ngroups = record.in_len / sizeof(gid_t);
+			if (record.nargs < RECORD_ROOT_NARGS || record.in_len % sizeof(gid_t) || ngroups > NGROUPS_MAX)
+				die("event %lu: malformed root", n);
+			for (size_t i = 1; i < ngroups; i++)
+				if (groups[i - 1] > groups[i])
+					die("event %lu: malformed root", n);
+			break;
+		}
+		default:
+			die("event %lu has unknown kind %u", n, record.kind);
+	}
+	return size;
+}
+
+/* Runs through the whole log once. */
+static void replay_pass(struct replay_t *replay, const char *log, size_t len)
+{
+	static gid_t out[NGROUPS_MAX];
+	size_t offset = sizeof(struct record_header_t);
+
+	while (offset < len) {
+		const struct record_t *record = (const void *) (log + offset);
+		offset += replay_check(replay, log + offset, len - offset);
+		replay->events++;
+
+		const uint64_t *args = (const void *) (record + 1);
+		const char *in = (const char *) (args + record->nargs);
+		const char *recorded = in + record->in_len;
+		size_t out_len;
+
+		struct proc_t *proc = replay_proc(replay, record->pid);
+		switch (record->kind) {
+			case RECORD_SYSCALL: {
+				uintptr_t ret = replay_syscall(replay, proc, record, args, in, out, &out_len);
+
+				replay->syscalls++;
+				if (ret == args[6] && out_len == record->out_len && !memcmp(out, recorded, out_len))
+					break;
+
+				replay->mismatches++;
+				if (!replay->quiet)
+					warn("event %lu: pid %u syscall %u returned %ld (recorded %ld)",
+					     replay->events, record->pid, record->number, (long) ret, (long) args[6]);
+				break;
+			}
+
+			case RECORD_ROOT: {
+				/* Start again from exactly what it had, rather than from our credentials. */
+				struct cred_t *cred = &proc->cred;
+				proc_new(proc);
+				proc->pid = proc->tgid = record->pid;
+				cred->uid = args[0];
+				cred->euid = args[1];
+				cred->suid = args[2];
+				cred->fsuid = args[3];
+				cred->gid = args[4];
+				cred->egid = args[5];
+				cred->sgid = args[6];
+				cred->fsgid = args[7];
+				cred->securebits = args[8];
+				cred->cap_inheritable = args[9];
+				cred->cap_permitted = args[10];
+				cred->cap_effective = args[11];
+				cred->cap_bset = args[12];
+				cred->cap_ambient = args[13];
+				cred->ngroups = record->in_len / sizeof(gid_t);
+				memcpy(cred->groups, in, record->in_len);
+				break;
+			}
+
+			case RECORD_CLONE: {
+				pid_t child = args[0];
+				struct proc_t new = {0};
+				proc_clone(&new, proc);
+				new.pid = child;
+				if (!ohm_insert(replay->procs, &child, sizeof(child), &new, sizeof(new)))
+					die("ohm_insert(%d) failed", child);
+				break;
+			}
+
+			case RECORD_EXEC: {
+				/* As in trace_exec, the thread that exec(2)ed takes over the leader. */
+				pid_t former = args[0];
+				if (former != proc->pid) {
+					struct proc_t *old = ohm_search(replay->procs, &former, sizeof(former));
+					if (old) {
+						*proc = *old;
+						proc->pid = record->pid;
+						ohm_remove(replay->procs, &former, sizeof(former));
+					}
+				}
+
+				struct cred_bprm_t bprm;
+				memcpy(&bprm, in, sizeof(bprm));
+				cred_exec(&proc->cred, &bprm);
+				break;
+			}
+
+			case RECORD_EXIT: {
+				pid_t pid = record->pid;
+				ohm_remove(replay->procs, &pid, sizeof(pid));
+				break;
+			}
+
+			default:
+				die("event %lu has unknown kind %u", replay->events, record->kind);
+		}
+	}
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	struct option long_options[] = {
+		{"passes", required_argument, NULL, 'n'},
+		{ "quiet",       no_argument, NULL, 'q'},
+		{  "help",       no_argument, NULL, 'h'},
+		{       0,                 0, NULL,   0},
+	};
+	int c, passes = 1;
+	bool quiet = false;
+
+	while ((c = getopt_long(argc, argv, "n:qh", long_options, NULL)) != -1) {
+		switch (c) {
+			case 'n':
+				passes = atoi(optarg);
+				if (passes <= 0)
+					rtfm("invalid number of passes: %s", optarg);
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			case 'h':
+			case '?':
+			default:
+				usage();
+				exit(c != 'h');
+		}
+	}
+	if (optind != argc - 1)
+		rtfm("exactly one log required");
+
+	const char *path = argv[optind];
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+		die("couldn't open %s: %m", path);
+	if ((size_t) st.st_size < sizeof(struct record_header_t))
+		die("%s isn't a record log", path);
+
+	const char *log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (log == MAP_FAILED)
+		die("couldn't map %s: %m", path);
+	close(fd);
+
+	const struct record_header_t *header = (const void *) log;
+	if (memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) || header->version != RECORD_VERSION)
+		die("%s isn't a (version %d) record log", path, RECORD_VERSION);
+
+	struct replay_t replay = {0};
+	uint64_t best = UINT64_MAX;
+
+	for (int i = 0; i < passes; i++) {
+		/* Only report mismatches once, they'll be the same every time. */
+		replay = (struct replay_t) {
+			.procs = ohm_init(4096, ohm_hash),
+			.quiet = quiet || i > 0,
+		};
+
+		uint64_t start = now();
+		replay_pass(&replay, log, st.st_size);
+		uint64_t elapsed = now() - start;
+		if (elapsed < best)
+			best = elapsed;
+
+		ohm_free(replay.procs);
+	}
+
+	printf("events=%lu syscalls=%lu mismatches=%lu ns=%llu ns_per_event=%.1f\n",
+	       replay.events, replay.syscalls, replay.mismatches, (unsigned long long) best,
+	       replay.events ? (double) best / replay.events : 0.0);
+	return replay.mismatches != 0;
+}
@@ -19,7 +19,14 @@
 #if !defined(REMAINROOT_SHIMS_H)
 #define REMAINROOT_SHIMS_H
 
+/*
+ * Set in the environment of everything we trace (to the tracer's pid), so
+ * that a nested remainroot knows to delegate to us. See remainroot.c.
+ */
+#define SUPERVISOR_ENV "REMAINROOT_SUPERVISOR"
+
 void shim_ptrace(int argc, char **argv);
+void shim_ptrace_serve(void);
 void shim_preload(int argc, char **argv);
 
 #endif
@@ -0,0 +1,157 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * newdomain.c checks that PR_REMAINROOT_NEW_DOMAIN (which a nested
+ * remainroot uses) doesn't give a tracee back anything it has given up: a
+ * dropped bounding capability, locked securebits or its groups. Without
+ * CAP_SETUID and CAP_SETGID, it has to fail with EPERM.
+ *
+ * Run without arguments, this is the test. It re-runs itself under
+ * remainroot (from $REMAINROOT) as the tracee, with --tracee.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/capability.h>
+#include <linux/securebits.h>
+
+#include "common.h"
+#include "core/cred.h"
+
+/* What automake's test driver takes to mean the test was skipped. */
+#define SKIP 77
+
+#define LOCKED (SECBIT_NOROOT | SECBIT_NOROOT_LOCKED)
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [--tracee]\n", __progname);
+}
+
+static uint64_t effective(void)
+{
+	struct __user_cap_header_struct header = { .version = _LINUX_CAPABILITY_VERSION_3 };
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {0};
+
+	if (syscall(SYS_capget, &header, data) < 0)
+		die("capget failed: %m");
+	return data[0].effective | (uint64_t) data[1].effective << 32;
+}
+
+/* As the tracee (which starts out as emulated root): returns what went wrong, or NULL. */
+static const char *check(void)
+{
+	gid_t groups[] = { 1, 2 }, got[NGROUPS_MAX];
+
+	if (setgroups(2, groups) < 0 ||
+	    prctl(PR_CAPBSET_DROP, CAP_SYS_ADMIN, 0, 0, 0) < 0 ||
+	    prctl(PR_SET_SECUREBITS, LOCKED, 0, 0, 0) < 0 ||
+	    syscall(SYS_setresgid, 50, 50, 50) < 0 ||
+	    syscall(SYS_setresuid, 1000, 0, 0) < 0)
+		return "couldn't set up";
+
+	if (prctl(PR_REMAINROOT_NEW_DOMAIN, 0, 0, 0, 0) < 0)
+		return "PR_REMAINROOT_NEW_DOMAIN failed";
+	if (getuid() || getgid())
+		return "not root afterwards";
+	if (prctl(PR_CAPBSET_READ, CAP_SYS_ADMIN, 0, 0, 0))
+		return "CAP_SYS_ADMIN is back in the bounding set";
+	if (effective() & (1ULL << CAP_SYS_ADMIN))
+		return "CAP_SYS_ADMIN is effective";
+	if (!(effective() & (1ULL << CAP_SETUID)))
+		return "CAP_SETUID isn't effective";
+	if ((prctl(PR_GET_SECUREBITS, 0, 0, 0, 0) & LOCKED) != LOCKED)
+		return "the locked securebits were cleared";
+	if (getgroups(NGROUPS_MAX, got) != 2 || got[0] != 1 || got[1] != 2)
+		return "the groups changed";
+
+	/* Without CAP_SETUID, it's not allowed at all. */
+	if (syscall(SYS_setuid, 1000) < 0)
+		return "couldn't drop privileges";
+	if (prctl(PR_REMAINROOT_NEW_DOMAIN, 0, 0, 0, 0) >= 0 || errno != EPERM)
+		return "PR_REMAINROOT_NEW_DOMAIN didn't fail with EPERM";
+	return NULL;
+}
+
+static int tracee(void)
+{
+	const char *err = check();
+
+	/* Our exit code is lost in the tracer, so report on stdout. */
+	printf("%s\n", err ? err : "ok");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 2 && !strcmp(argv[1], "--tracee"))
+		return tracee();
+	if (argc != 1)
+		rtfm("unexpected arguments");
+
+	const char *remainroot = getenv("REMAINROOT");
+	if (!remainroot)
+		return SKIP;
+
+	char self[PATH_MAX], out[256];
+	if (!realpath(argv[0], self))
+		die("couldn't find ourselves: %m");
+
+	int fds[2];
+	if (pipe(fds) < 0)
+		die("pipe failed: %m");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(remainroot, remainroot, "-s", "ptrace", self, "--tracee", NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	ssize_t n, done = 0;
+	while ((n = read(fds[0], out + done, sizeof(out) - 1 - done)) > 0)
+		done += n;
+	out[done] = '\0';
+	out[strcspn(out, "\n")] = '\0';
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+		die("couldn't run %s", remainroot);
+	if (strcmp(out, "ok")) {
+		warn("tracee: %s", out);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * remainroot: a shim to trick code to run in a rootless container
+ * Copyright (C) 2016 Aleksa Sarai <asarai@suse.de>
+ *
+ * remainroot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * remainroot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with remainroot.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * xattr.c checks that a tracee which isn't (emulated) root can't change
+ * the real security.* xattrs of a file. Under --userns the tracee really
+ * is root in its namespace, so if we let the syscall through it would
+ * succeed on disk even though we tell it EPERM.
+ *
+ * Run without arguments, this is the test. It re-runs itself under
+ * remainroot (from $REMAINROOT) as the tracee, with --set or --remove.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <linux/capability.h>
+
+#include "common.h"
+
+/* What automake's test driver takes to mean the test was skipped. */
+#define SKIP 77
+
+#define NAME "security.capability"
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s [--set|--remove <file>]\n", __progname);
+}
+
+/* Some file capabilities, which only need to be valid. */
+static struct vfs_cap_data caps = {
+	.magic_etc = VFS_CAP_REVISION_2,
+	.data = { { .permitted = 1 << CAP_NET_BIND_SERVICE } },
+};
+
+/* As the tracee: drop to an unprivileged (emulated) uid and try to change path's xattr. */
+static int tracee(const char *mode, const char *path)
+{
+	if (syscall(SYS_setuid, 1000) < 0)
+		die("setuid failed: %m");
+
+	int ret;
+	if (!strcmp(mode, "--set"))
+		ret = lsetxattr(path, NAME, &caps, sizeof(caps), 0);
+	else
+		ret = lremovexattr(path, NAME);
+
+	/* Our exit code is lost in the tracer, so report on stdout. */
+	printf("%s\n", ret < 0 ? strerror(errno) : "ok");
+	return 0;
+}
+
+static void write_file(const char *path, const char *data)
+{
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0 || write(fd, data, strlen(data)) != (ssize_t) strlen(data))
+		exit(SKIP);
+	close(fd);
+}
+
+/*
+ * Really sets path's xattr, as root in a user namespace of our own. Returns
+ * whether that was possible.
+ */
+static bool real_set(const char *path)
+{
+	uid_t uid = geteuid();
+	gid_t gid = getegid();
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		char map[64];
+		if (unshare(CLONE_NEWUSER) < 0)
+			_exit(SKIP);
+		write_file("/proc/self/setgroups", "deny");
+		snprintf(map, sizeof(map), "0 %u 1\n", uid);
+		write_file("/proc/self/uid_map", map);
+		snprintf(map, sizeof(map), "0 %u 1\n", gid);
+		write_file("/proc/self/gid_map", map);
+		_exit(lsetxattr(path, NAME, &caps, sizeof(caps), 0) < 0 ? SKIP : 0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	return WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+/* Runs ourselves with mode under remainroot --userns, returning what the tracee printed. */
+static void run(const char *remainroot, const char *self, const char *mode, const char *path,
+                char *out, size_t len)
+{
+	int fds[2];
+	if (pipe(fds) < 0)
+		die("pipe failed: %m");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		die("fork failed: %m");
+	if (!pid) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(remainroot, remainroot, "-s", "ptrace", "--userns", self, mode, path, NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	ssize_t n, done = 0;
+	while ((n = read(fds[0], out + done, len - 1 - done)) > 0)
+		done += n;
+	out[done] = '\0';
+	out[strcspn(out, "\n")] = '\0';
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %m");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+		die("couldn't run %s", remainroot);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 3)
+		return tracee(argv[1], argv[2]);
+	if (argc != 1)
+		rtfm("unexpected arguments");
+
+	const char *remainroot = getenv("REMAINROOT");
+	if (!remainroot)
+		return SKIP;
+
+	char self[PATH_MAX], dir[] = "xattr-XXXXXX", path[PATH_MAX], out[256];
+	if (!realpath(argv[0], self) || !mkdtemp(dir))
+		die("couldn't set up: %m");
+	snprintf(path, sizeof(path), "%s/file", dir);
+	int fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+	if (fd < 0)
+		die("couldn't create %s: %m", path);
+	close(fd);
+
+	int ret = 0;
+
+	/* Setting: the tracee gets EPERM, and the file has no xattr afterwards. */
+	run(remainroot, self, "--set", path, out, sizeof(out));
+	if (strcmp(out, strerror(EPERM))) {
+		warn("set: tracee got \"%s\", expected EPERM", out);
+		ret = 1;
+	}
+	if (lgetxattr(path, NAME, NULL, 0) >= 0 || errno != ENODATA) {
+		warn("set: %s was really set", NAME);
+		ret = 1;
+	}
+
+	/* Removing: the tracee gets EPERM, and the real xattr is still there. */
+	if (!real_set(path)) {
+		warn("can't set %s for real here, skipping removal", NAME);
+	} else {
+		run(remainroot, self, "--remove", path, out, sizeof(out));
+		if (strcmp(out, strerror(EPERM))) {
+			warn("remove: tracee got \"%s\", expected EPERM", out);
+			ret = 1;
+		}
+		if (lgetxattr(path, NAME, NULL, 0) < 0) {
+			warn("remove: %s was really removed: %m", NAME);
+			ret = 1;
+		}
+	}
+
+	unlink(path);
+	rmdir(dir);
+	return ret;
+}